@@ -0,0 +1,369 @@
+/*服务器热点函数的微基准测试
+  用 socketpair 模拟客户端：一端交给服务器逻辑，另一端由测试程序读空
+  结果中 n 为在线用户数，搜索相关的测试中为历史消息条数
+  用法: make bench 或 ./chat_bench [名字过滤]*/
+#include "chat.h"
+#include <stdint.h>
+#include <sys/resource.h>
+
+#define BENCH_TARGET_NS 200000000.0 // 每组参数至少测量200ms
+#define BENCH_MAX_ITERS 10000000UL
+#define BENCH_MAX_PEERS 8192        // socketpair 数量上限，用户多时多个用户共用一个对端
+#define BENCH_SNDBUF    (4 << 20)   // 尽量放大发送缓冲区，减少广播时的丢包
+
+//=============== 分配和发送计数（链接时 --wrap） ===============
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_sendmsg(int fd, const struct msghdr *msg, int flags);
+
+static unsigned long alloc_count, alloc_bytes, send_errors;
+
+void *__wrap_malloc(size_t size)
+{
+   alloc_count++;
+   alloc_bytes += size;
+   return __real_malloc(size);
+}
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+   alloc_count++;
+   alloc_bytes += nmemb * size;
+   return __real_calloc(nmemb, size);
+}
+void *__wrap_realloc(void *ptr, size_t size)
+{
+   alloc_count++;
+   alloc_bytes += size;
+   return __real_realloc(ptr, size);
+}
+void __wrap_free(void *ptr)
+{
+   __real_free(ptr);
+}
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags)
+{
+   ssize_t n = __real_send(fd, buf, len, flags);
+   if (n < 0)
+      send_errors++; // 对端缓冲区满(EAGAIN)，真实服务器里这条消息就丢了
+   return n;
+}
+ssize_t __wrap_sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+   ssize_t n = __real_sendmsg(fd, msg, flags);
+   if (n < 0)
+      send_errors++;
+   return n;
+}
+
+//=============== 假的客户端 ===============
+static int (*peers)[2]; // peers[i][0] 给服务器逻辑, peers[i][1] 模拟客户端
+static int npeers;
+static int probe[2];    // list_online 的接收方
+static FILE *report;    // 测试结果输出（stdout 被重定向到 /dev/null，屏蔽服务器日志）
+
+static void set_peer(int fds[2])
+{
+   int sz = BENCH_SNDBUF;
+   fcntl(fds[0], F_SETFL, O_NONBLOCK); // 和 acceptconnect 一样设置为非阻塞
+   fcntl(fds[1], F_SETFL, O_NONBLOCK);
+   setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+   setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+}
+
+static int fd_budget()
+{
+   struct rlimit rl;
+   getrlimit(RLIMIT_NOFILE, &rl);
+   rl.rlim_cur = rl.rlim_max; // 尽量用到硬上限
+   setrlimit(RLIMIT_NOFILE, &rl);
+   getrlimit(RLIMIT_NOFILE, &rl);
+   int budget = (int)((rl.rlim_cur - 64) / 2);
+   return budget < BENCH_MAX_PEERS ? budget : BENCH_MAX_PEERS;
+}
+
+static void drain_fd(int fd)
+{
+   char buf[65536];
+   while (read(fd, buf, sizeof(buf)) > 0)
+      ;
+}
+
+static void peers_drain()
+{
+   for (int i = 0; i < npeers; i++)
+      drain_fd(peers[i][1]);
+   drain_fd(probe[1]);
+}
+
+/*建立 users 个在线用户: client_list 和 ep_events 都按服务器登录后的样子填好*/
+static void users_open(int users)
+{
+   char name[32];
+   int budget = fd_budget();
+
+   npeers = users < budget ? users : budget;
+   peers = __real_malloc(sizeof(*peers) * npeers);
+   for (int i = 0; i < npeers; i++)
+   {
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, peers[i]) < 0)
+      {
+         perror("socketpair");
+         exit(1);
+      }
+      set_peer(peers[i]);
+   }
+
+   init_list();
+   for (int i = 0; i < users; i++)
+   {
+      snprintf(name, sizeof(name), "user%d", i);
+      client_list_add(peers[i % npeers][0], name);
+      if (i < MAX_EVENTS - 1) // 最后一个位置留给监听socket
+      {
+         ep_events[i].m_fd = peers[i % npeers][0];
+         strcpy(ep_events[i].m_id, name);
+      }
+   }
+   online_count = users;
+}
+
+/*所有对端都协商成 codec 编码*/
+static void users_codec(int codec)
+{
+   for (int i = 0; i < npeers; i++)
+      codec_set(peers[i][0], codec);
+}
+
+static void users_close()
+{
+   users_codec(CODEC_NONE);
+   cleanup_client_list();
+   client_list = NULL;
+   online_count = 0;
+   memset(ep_events, 0, sizeof(ep_events));
+   for (int i = 0; i < npeers; i++)
+   {
+      close(peers[i][0]);
+      close(peers[i][1]);
+   }
+   __real_free(peers);
+   peers = NULL;
+   npeers = 0;
+}
+
+//=============== 被测操作 ===============
+static char login_input[] = "zhangsan 123456";
+static char *private_input; // "@name 内容"
+static char *broadcast_input;
+static struct my_events bench_ev;
+
+static void op_login_str()
+{
+   char name[32], password[32];
+   login_str(login_input, name, password, sizeof(name), sizeof(password));
+}
+
+static void op_private()
+{
+   char name[32];
+   // 和 recvdata 一样：先解析，再按名字找接收方
+   if (parse_private(private_input, name, sizeof(name)) != NULL)
+      find_user_fd(name);
+}
+
+static void op_id_exists()
+{
+   id_exists("nobody"); // 不存在的名字，走完整个链表
+}
+
+static void op_list_online()
+{
+   list_online(probe[0]);
+}
+
+static void op_broadcast()
+{
+   broadcast(&bench_ev, broadcast_input);
+}
+
+//=============== 聊天记录和搜索 ===============
+static const char *vocab[] = {
+   "hello", "world", "server", "client", "epoll", "socket", "deploy", "build",
+   "lunch", "coffee", "meeting", "today", "tomorrow", "bug", "fix", "release",
+   "今", "天", "气", "很", "好", "吃", "饭", "了", "吗", "我", "们", "去", "开", "会", "明", "早",
+};
+static const char *search_input;
+static unsigned int bench_rand = 12345;
+
+static void make_history_text(char *buf, size_t size)
+{
+   size_t len = 0;
+   const int nvocab = sizeof(vocab) / sizeof(vocab[0]);
+   for (int w = 0; w < 8; w++)
+   {
+      bench_rand = bench_rand * 1103515245 + 12345; // 固定种子，每次运行结果一致
+      len += snprintf(buf + len, size - len, "%s ", vocab[(bench_rand >> 16) % nvocab]);
+   }
+   if (bench_rand % 10007 == 0) // 少量消息带一个罕见词
+      snprintf(buf + len, size - len, "needle");
+}
+
+static void op_history_add()
+{
+   char text[256];
+   make_history_text(text, sizeof(text));
+   history_add("bench", "", text);
+}
+
+static void op_search()
+{
+   unsigned long found[SEARCH_RESULTS_MAX];
+   int total;
+   search_query(search_input, found, SEARCH_RESULTS_MAX, &total);
+}
+
+static char *make_message(const char *prefix, int size)
+{
+   char *msg = __real_malloc(size + 1);
+   int n = snprintf(msg, size + 1, "%s", prefix);
+   memset(msg + n, 'x', size - n - 1);
+   msg[size - 1] = '\n';
+   msg[size] = '\0';
+   return msg;
+}
+
+//=============== 测试框架 ===============
+static double now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const char *filter;
+
+/*反复执行 op 直到累计满 BENCH_TARGET_NS
+  drain 为真时每次操作后读空对端（不计入耗时），否则整批计时*/
+static void run(const char *name, int users, int size, void (*op)(), int drain)
+{
+   unsigned long iters = 0, batch = 1, allocs = 0, bytes = 0, drops = 0;
+   double spent = 0;
+
+   if (filter != NULL && strstr(name, filter) == NULL)
+      return;
+
+   while (spent < BENCH_TARGET_NS && iters < BENCH_MAX_ITERS)
+   {
+      unsigned long a0 = alloc_count, b0 = alloc_bytes, e0 = send_errors;
+      if (drain)
+      {
+         for (unsigned long i = 0; i < batch; i++)
+         {
+            double t0 = now_ns();
+            op();
+            spent += now_ns() - t0;
+            peers_drain();
+         }
+      }
+      else
+      {
+         double t0 = now_ns();
+         for (unsigned long i = 0; i < batch; i++)
+            op();
+         spent += now_ns() - t0;
+      }
+      allocs += alloc_count - a0;
+      bytes += alloc_bytes - b0;
+      drops += send_errors - e0;
+      iters += batch;
+      batch *= 2;
+   }
+
+   fprintf(report, "%-20s %8d %6d %10lu %14.1f %10.2f %10.1f %10.2f\n",
+           name, users, size, iters, spent / iters,
+           (double)allocs / iters, (double)bytes / iters, (double)drops / iters);
+   fflush(report);
+}
+
+int main(int argc, char *argv[])
+{
+   static const int user_sweep[] = {10, 100, 1000, 10000, 100000};
+   static const int size_sweep[] = {16, 256, 4096};
+   const int nusers = sizeof(user_sweep) / sizeof(user_sweep[0]);
+   const int nsizes = sizeof(size_sweep) / sizeof(size_sweep[0]);
+
+   if (argc > 1)
+      filter = argv[1];
+
+   // 服务器函数里的 printf 会刷屏，结果单独输出
+   report = fdopen(dup(STDOUT_FILENO), "w");
+   if (report == NULL || freopen("/dev/null", "w", stdout) == NULL)
+   {
+      perror("redirect stdout");
+      exit(1);
+   }
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, probe) < 0)
+   {
+      perror("socketpair");
+      exit(1);
+   }
+   set_peer(probe);
+   bench_ev.m_fd = probe[0];
+
+   fprintf(report, "%-20s %8s %6s %10s %14s %10s %10s %10s\n",
+           "benchmark", "n", "size", "iters", "ns/op", "allocs/op", "B/op", "drops/op");
+
+   run("login_str", 0, sizeof(login_input) - 1, op_login_str, 0);
+
+   for (int u = 0; u < nusers; u++)
+   {
+      users_open(user_sweep[u]);
+      for (int s = 0; s < nsizes; s++)
+      {
+         private_input = make_message("@nobody ", size_sweep[s]);
+         private_input[size_sweep[s] - 1] = 'x'; // 不带换行，parse_private 不修改输入，可以重复使用
+         run("private_parse", user_sweep[u], size_sweep[s], op_private, 0);
+         __real_free(private_input);
+      }
+      run("id_exists", user_sweep[u], 0, op_id_exists, 0);
+      run("list_online", user_sweep[u], 0, op_list_online, 1);
+      for (int s = 0; s < nsizes; s++)
+      {
+         broadcast_input = make_message("bench: ", size_sweep[s]);
+         run("broadcast", user_sweep[u], size_sweep[s], op_broadcast, 1);
+         users_codec(CODEC_DEFLATE);
+         run("broadcast_deflate", user_sweep[u], size_sweep[s], op_broadcast, 1);
+         users_codec(CODEC_NONE);
+         __real_free(broadcast_input);
+      }
+      users_close();
+   }
+
+   static const int history_sweep[] = {10000, 1000000, HISTORY_MAX};
+   static const char *queries[] = {"needle", "hello", "hello world", "天气"};
+   const int nhistory = sizeof(history_sweep) / sizeof(history_sweep[0]);
+   const int nqueries = sizeof(queries) / sizeof(queries[0]);
+   for (int h = 0; h < nhistory; h++)
+   {
+      if (filter != NULL && strstr("history_add", filter) == NULL && strncmp(filter, "search", 6) != 0)
+         break; // 填充历史记录比较慢，不需要时跳过
+      history_init();
+      for (int i = 0; i < history_sweep[h]; i++)
+         op_history_add();
+      for (int q = 0; q < nqueries; q++)
+      {
+         char name[32];
+         snprintf(name, sizeof(name), "search:%s", queries[q]);
+         search_input = queries[q];
+         run(name, history_sweep[h], 0, op_search, 0);
+      }
+      run("history_add", history_sweep[h], 0, op_history_add, 0);
+      history_cleanup();
+   }
+
+   fclose(report);
+   return 0;
+}
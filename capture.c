@@ -0,0 +1,144 @@
+/*流量录制：./server --capture 文件 把每个连接的建立、recvdata 每次读到的一批数据（带时间）和断开写入二进制文件
+  服务器的行为取决于一次 recvdata 读到哪些字节（半行、多行粘在一起），
+  chat_replay 按同样的边界把数据重新喂给服务器逻辑，复现线上的到达方式
+
+  文件格式: CAPTURE_MAGIC 之后是一条条记录
+     类型(1字节) 距上一条的微秒数(varint) 连接号(varint)
+     CAPTURE_ACCEPT 之后跟 1 字节标志（bit0: 受信任的本机连接）
+     CAPTURE_DATA   之后跟 长度(varint) 和数据
+     CAPTURE_CLOSE  没有后续（对端断开、读出错或超时被踢）
+  连接号就是服务器上的 fd，fd 复用前一定先有 CAPTURE_CLOSE 或新的 CAPTURE_ACCEPT*/
+#include "chat.h"
+#include <sys/stat.h>
+
+static FILE *capture_file = NULL;
+static uint64_t capture_last; // 上一条记录的时间（微秒）
+
+static uint64_t now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void put_varint(uint64_t v)
+{
+   while (v >= 0x80)
+   {
+      putc((v & 0x7f) | 0x80, capture_file);
+      v >>= 7;
+   }
+   putc(v, capture_file);
+}
+
+static void put_record(int type, int fd)
+{
+   uint64_t now = now_us();
+   putc(type, capture_file);
+   put_varint(now - capture_last);
+   put_varint(fd);
+   capture_last = now;
+}
+
+/*开始录制，文件已存在时覆盖；失败返回-1
+  录下的数据里有登录密码和私聊原文，只让服务器自己的用户读*/
+int capture_open(const char *path)
+{
+   int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd < 0 || fchmod(fd, 0600) < 0 || (capture_file = fdopen(fd, "wb")) == NULL) // 已存在的文件保留原来的权限，要改掉
+   {
+      perror("capture open error");
+      if (fd >= 0)
+         close(fd);
+      return -1;
+   }
+   fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC) - 1, capture_file);
+   fflush(capture_file);
+   capture_last = now_us();
+   return 0;
+}
+
+void capture_accept(int fd, int trusted)
+{
+   if (capture_file == NULL)
+      return;
+   put_record(CAPTURE_ACCEPT, fd);
+   putc(trusted ? 1 : 0, capture_file);
+   fflush(capture_file); // 每条记录都写到文件，崩溃或 kill -9 时不丢最后的部分
+}
+
+/*recvdata 读到 EAGAIN 为止的一批数据记一条，边界和服务器实际处理的一致*/
+void capture_data(int fd, const char *buf, size_t len)
+{
+   if (capture_file == NULL)
+      return;
+   put_record(CAPTURE_DATA, fd);
+   put_varint(len);
+   fwrite(buf, 1, len, capture_file);
+   fflush(capture_file);
+}
+
+void capture_close(int fd)
+{
+   if (capture_file == NULL)
+      return;
+   put_record(CAPTURE_CLOSE, fd);
+   fflush(capture_file);
+}
+
+void capture_cleanup()
+{
+   if (capture_file == NULL)
+      return;
+   fclose(capture_file);
+   capture_file = NULL;
+}
+
+//=============== 读取（chat_replay 用） ===============
+static int get_varint(FILE *fp, uint64_t *v)
+{
+   int c, shift = 0;
+   *v = 0;
+   do
+   {
+      if ((c = getc(fp)) == EOF || shift > 63)
+         return -1;
+      *v |= (uint64_t)(c & 0x7f) << shift;
+      shift += 7;
+   } while (c & 0x80);
+   return 0;
+}
+
+/*读下一条记录到 rec，数据放在 buf（最多 size 字节）
+  返回1读到一条，0文件结束，-1格式错误*/
+int capture_next(FILE *fp, struct capture_record *rec, char *buf, size_t size)
+{
+   uint64_t v;
+   int type = getc(fp);
+
+   if (type == EOF)
+      return 0;
+   rec->type = type;
+   if (get_varint(fp, &rec->delta_us) < 0 || get_varint(fp, &v) < 0)
+      return -1;
+   rec->conn = v;
+   rec->len = 0;
+   rec->trusted = 0;
+   switch (type)
+   {
+   case CAPTURE_ACCEPT:
+      if ((rec->trusted = getc(fp)) == EOF)
+         return -1;
+      break;
+   case CAPTURE_DATA:
+      if (get_varint(fp, &v) < 0 || v > size || fread(buf, 1, v, fp) != v)
+         return -1;
+      rec->len = v;
+      break;
+   case CAPTURE_CLOSE:
+      break;
+   default:
+      return -1;
+   }
+   return 1;
+}
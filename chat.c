@@ -0,0 +1,219 @@
+#include "chat.h"
+
+struct client_node *client_list;
+int online_count = 0;
+
+// =============== 函数声明和定义 ===============
+//链表操作函数
+void init_list()
+{
+   client_list = (struct client_node *)malloc(sizeof(struct client_node));
+   client_list->next = NULL; // 虚拟头节点的fd不需要赋值
+}
+void client_list_add(int fd,char *name)
+{ // 头插法添加
+   struct client_node *node = (struct client_node *)malloc(sizeof(struct client_node));
+   node->user.fd = fd;
+   strcpy(node->user.name, name);
+   node->next = client_list->next;
+   client_list->next = node;
+}
+void client_list_delete(int fd)
+{
+   struct client_node *curr = client_list;
+   while (curr->next != NULL)
+   {
+      if (curr->next->user.fd == fd)
+      {
+         struct client_node *temp = curr->next;
+         curr->next = curr->next->next;
+         free(temp);
+         return;
+      }
+      curr = curr->next;
+   }
+}
+void cleanup_client_list() {
+   struct client_node *curr = client_list;
+   while (curr != NULL) {
+      struct client_node *next = curr->next;
+      free(curr);
+      curr = next;
+   }
+}
+//字符串处理
+int login_str(const char *input ,char *name, char *password, size_t name_size, size_t password_size){
+   char temp_username[64] = {0};  // 临时缓冲区设置大一点
+   char temp_password[64] = {0};  // 临时缓冲区设置大一点
+
+   // 读取到换行符之前的两个字符串
+   int matched = sscanf(input, "%63s %63s", temp_username, temp_password);
+
+   if (matched != 2) {
+      return -1;  // 格式不正确
+   }
+
+   // 安全地复制到目标缓冲区
+   strncpy(name, temp_username, name_size - 1);
+   name[name_size - 1] = '\0';
+
+   strncpy(password, temp_password, password_size - 1);
+   password[password_size - 1] = '\0';
+
+   return 0;
+}
+/*解析私聊消息 "@name 内容"
+  用户名最多取 name_size-1 个字符，内容去掉结尾换行符；没有空格分隔内容时返回NULL*/
+char *parse_private(char *input, char *name, size_t name_size)
+{
+   size_t i;
+   for(i = 1; input[i] != ' ' && input[i] != '\0' && i < name_size; i++) {
+      name[i-1] = input[i];
+   }
+   name[i-1] = '\0';
+
+   //获取消息内容
+   char *msg_content = strchr(input + 1, ' ');
+   if(msg_content == NULL){
+      return NULL;
+   }
+   msg_content++; // 跳过空格
+   msg_content[strcspn(msg_content, "\n")] = 0;
+   return msg_content;
+}
+//广播函数
+void broadcast(struct my_events *ev, char *buf)
+{
+   struct client_node *curr = client_list->next;
+   size_t buf_len = strlen(buf);
+   struct codec_cache cache; // 第一个要压缩的接收者触发压缩，之后复用
+   int len;
+   cache.ready = 0;
+   while (curr != NULL)
+   {
+      /*if (curr->fd == ev->m_fd){
+         curr = curr->next;
+         continue;
+      }*/
+      len = codec_send(curr->user.fd, buf, buf_len, &cache); // 回写
+      printf("send success\n");
+      if (len < 0)
+      {
+         printf("\n send[fd=%d] to %d error \n", ev->m_fd, curr->user.fd);
+      }
+      curr = curr->next;
+   }
+}
+//广播系统通知（加入/离开），带编号并存入聊天记录
+void broadcast_notice(struct my_events *ev, const char *text)
+{
+   char buf[BUFSIZ];
+   unsigned long seq = history_add("", "", text);
+   history_format(history_get(seq), "", buf, sizeof(buf));
+   broadcast(ev, buf);
+}
+//检测重复名函数
+int id_exists(const char *name){
+   int is_exist = 0;
+   struct client_node *cur = client_list->next;
+   while(cur != NULL){
+      if(strcmp(cur->user.name,name) == 0){
+         is_exist = 1;
+         break;
+      }
+      cur = cur->next;
+   }
+   return is_exist;
+}
+//用户名 密码核对，user_password 为NULL时只检查用户是否存在
+int verify_user(char *user_name, char *user_password){
+   FILE *fp = fopen("user.txt", "r");
+   if(fp == NULL){
+      perror("open user.txt error");
+      return 0;
+   }
+
+   char line[64];
+   char file_username[32];
+   char file_password[32];
+
+   while(fgets(line,sizeof(line),fp)){
+      if(sscanf(line,"%31s %31s",file_username, file_password) == 2){
+         if (strcmp(user_name, file_username) == 0 && (user_password == NULL || strcmp(user_password, file_password) == 0)) {
+            fclose(fp);
+            return 1; // 验证成功
+         }
+      }
+   }
+   fclose(fp);
+   return 0;
+}
+
+void list_online(int cfd){
+   struct client_node *cur = client_list->next;
+   char buf[BUFSIZ];
+   const char tail[] = "\n—————————————————————————————————————————————" COLOR_RESET "\n"; // 以换行结尾，客户端按行解析
+   const char more[] = "\n - ...";
+   size_t room = sizeof(buf) - sizeof(tail) - sizeof(more); // 为结尾预留位置
+   size_t len;
+
+   len = snprintf(buf, room, "%s%s\n当前在线人数: %d 人\n在线列表：", COLOR_GREEN,STYLE_BOLD,online_count);
+   while(cur != NULL){
+      // 人数多时一个包放不下，超出部分用"..."代替，避免写穿栈上缓冲区
+      int n = snprintf(buf + len, room - len, "\n - %s", cur->user.name);
+      if(n < 0 || len + n >= room){
+         memcpy(buf + len, more, sizeof(more) - 1);
+         len += sizeof(more) - 1;
+         break;
+      }
+      len += n;
+      cur = cur->next;
+   }
+   memcpy(buf + len, tail, sizeof(tail) - 1);
+   len += sizeof(tail) - 1;
+   chat_send(cfd, buf, len);
+}
+
+void search_messages(int cfd, const char *query){
+   unsigned long found[SEARCH_RESULTS_MAX];
+   char buf[BUFSIZ];
+   const char tail[] = "\n—————————————————————————————————————————————" COLOR_RESET "\n"; // 以换行结尾，客户端按行解析
+   size_t room = sizeof(buf) - sizeof(tail);
+   size_t len;
+   struct timespec t0, t1;
+
+   while(*query == ' ')
+      query++;
+   size_t qlen = strcspn(query, "\r\n");
+
+   char term[256];
+   snprintf(term, sizeof(term), "%.*s", (int)qlen, query);
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   int total;
+   int shown = search_query(term, found, SEARCH_RESULTS_MAX, &total);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+   // 查询找够条数就停，不一定知道总数
+   if(total >= 0)
+      len = snprintf(buf, room, "%s%s\n搜索 \"%s\": 共 %d 条, 显示最近 %d 条 (%.2f ms)", COLOR_GREEN,STYLE_BOLD,
+                     term, total, shown, ms);
+   else
+      len = snprintf(buf, room, "%s%s\n搜索 \"%s\": 显示最近 %d 条, 更早的结果未统计 (%.2f ms)", COLOR_GREEN,STYLE_BOLD,
+                     term, shown, ms);
+   // 结果从新到旧，按时间顺序倒着输出
+   for(int i = shown - 1; i >= 0; i--){
+      struct history_entry *e = history_get(found[i]);
+      if(e == NULL)
+         continue;
+      char when[16];
+      strftime(when, sizeof(when), "%H:%M:%S", localtime(&e->time));
+      int n = snprintf(buf + len, room - len, "\n [%s] %s: %s", when, e->from, e->text);
+      if(n < 0 || len + n >= room) // 放不下的结果不发
+         break;
+      len += n;
+   }
+   memcpy(buf + len, tail, sizeof(tail) - 1);
+   len += sizeof(tail) - 1;
+   chat_send(cfd, buf, len);
+}
@@ -0,0 +1,245 @@
+#ifndef CHAT_H
+#define CHAT_H
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include "codec.h"
+
+#define MAX_EVENTS 1024
+#define SERVER_PORT 8000
+#define HANDOFF_PATH "/tmp/chat_server.handoff" // 热重启交接用的 Unix socket
+#define UNIX_PATH "/tmp/chat_server.sock"          // 本机客户端和机器人用的 Unix socket
+#define UNIX_MODE 0666                             // Unix socket 的权限，谁能连由 SO_PEERCRED 和 --trust-uid 决定
+#define TRUSTED_UID_MAX 16                         // --trust-uid 最多个数
+
+// ep_events 末尾的保留位置，客户端从前往后分配
+#define HANDOFF_SLOT (MAX_EVENTS - 2)     // 热重启交接监听（MAX_EVENTS - 1 是 TCP 监听）
+#define UNIX_LISTEN_SLOT (MAX_EVENTS - 3) // Unix socket 监听
+
+#define HISTORY_MAX (1 << 21)    // 保留的历史消息条数
+#define SEARCH_TOKEN_MAX 32       // 索引词的最大长度（含'\0'）
+#define SEARCH_TERMS_MAX 8        // 一次查询最多的词数
+#define SEARCH_RESULTS_MAX 20     // /search 最多返回的条数
+#define SEARCH_SCAN_MAX 20000     // 一次查询最多检查的候选编号数，限制查询占用 reactor 的时间
+
+#define CODEC_MAX_FD 65536        // 记录压缩编码的fd上限，超出的连接不压缩
+#define CODEC_PAYLOAD_MAX (2 * BUFSIZ) // 超过这个长度的消息不压缩
+
+#define SESSION_MAX 2048          // 同时保留的会话令牌数
+#define SESSION_TTL 600           // 断线后令牌保留的秒数
+#define SESSION_TOKEN_LEN 16      // 令牌长度（十六进制字符）
+#define RESUME_REPLAY_MAX 500     // 重连时最多补发的消息条数
+
+#define CAPTURE_MAGIC "CHATCAP1"  // 录制文件开头
+
+#define COLOR_RED    "\033[31m"      // 红色
+#define COLOR_GREEN  "\033[32m"      // 绿色
+#define STYLE_BOLD   "\033[1m"       // 粗体
+#define COLOR_RESET  "\033[0m"       // 重置所有属性
+
+//=============== 数据结构 ===============
+struct user
+{
+   int fd;
+   char name[32];
+   char password[32];
+};
+
+struct client_node
+{
+   struct user user;
+   struct client_node *next;
+};
+
+struct history_entry
+{
+   unsigned long seq;  // 消息编号，从1开始递增
+   time_t time;
+   char from[32];      // 发送者，系统通知为空
+   char to[32];        // 私聊的接收者，广播为空
+   char *text;
+};
+
+struct codec_cache
+{
+   int ready;                     // 0: 还没压缩
+   unsigned char header[4];       // 帧头
+   const unsigned char *data;     // 帧数据，指向 frame 或原始消息
+   size_t len;
+   unsigned char frame[CODEC_PAYLOAD_MAX];
+};
+
+struct session
+{
+   char token[SESSION_TOKEN_LEN + 1];
+   char name[32];
+   time_t expire;      // 0: 在线；断线后为令牌失效的时间
+};
+
+enum capture_type
+{
+   CAPTURE_ACCEPT = 1, // 新连接
+   CAPTURE_DATA,       // recvdata 一次读到的数据
+   CAPTURE_CLOSE,      // 对端断开
+};
+
+struct capture_record
+{
+   int type;
+   uint64_t delta_us; // 距上一条记录的微秒数
+   int conn;          // 录制时的 fd
+   int trusted;       // CAPTURE_ACCEPT: 受信任的本机连接
+   size_t len;        // CAPTURE_DATA: 数据长度
+};
+
+struct my_events
+{
+   void *m_arg;                                     // 泛型参数，难点
+   int m_event;                                     // 监听的事件
+   int m_fd;                                        // 监听的文件描述符
+   void (*call_back)(int fd, int event, void *arg); // 回调函数
+
+   char m_buf[BUFSIZ];
+   char m_id[32];
+   int m_buf_len;
+   int m_status;      // 是否在红黑树上, 1->在, 0->不在
+   time_t m_lasttime; // 最后放入红黑树的时间
+   int m_trusted;     // 1: 受信任的本机用户(SO_PEERCRED)，登录时不检查密码
+};
+
+//=============== 全局变量 ===============
+extern struct client_node *client_list;     // chat.c
+extern int online_count;                    // chat.c
+extern volatile sig_atomic_t server_running; // event.c 置0后主循环退出
+extern int ep_fd;                           // event.c 红黑树根（epoll_create返回的句柄）
+extern struct my_events ep_events[MAX_EVENTS]; // event.c
+extern int handed_off;                      // handoff.c 1: 状态已交给新进程
+
+// =============== chat.c: 会话逻辑 ===============
+//链表操作函数
+void init_list();
+void client_list_add(int fd,char *name);
+void client_list_delete(int fd);
+void cleanup_client_list();
+//字符串处理
+int login_str(const char *input ,char *name, char *password, size_t name_size, size_t password_size);
+/*解析私聊消息 "@name 内容"，返回内容起始位置，格式不正确返回NULL*/
+char *parse_private(char *input, char *name, size_t name_size);
+//广播函数
+void broadcast(struct my_events *ev, char *buf);
+//广播系统通知（加入/离开），带编号并存入聊天记录
+void broadcast_notice(struct my_events *ev, const char *text);
+//检测重复名函数
+int id_exists(const char *name);
+//用户名 密码核对，user_password 为NULL时只检查用户是否存在
+int verify_user(char *user_name, char *user_password);
+//发送在线列表
+void list_online(int cfd);
+//搜索聊天记录并发送结果
+void search_messages(int cfd, const char *query);
+
+// =============== history.c: 聊天记录 ===============
+void history_init();
+/*保存一条消息，返回分配的编号；from 为空表示系统通知，to 不为空表示私聊；正文中的换行换成空格*/
+unsigned long history_add(const char *from, const char *to, const char *text);
+/*热重启时按原编号恢复一条消息*/
+void history_restore(unsigned long seq, time_t when, const char *from, const char *to, const char *text);
+/*按编号取消息，已过期或不存在返回NULL*/
+struct history_entry *history_get(unsigned long seq);
+/*当前保留的编号范围，没有消息时 *first > *last*/
+void history_range(unsigned long *first, unsigned long *last);
+/*viewer 能否看到这条消息：私聊只有双方能看到*/
+int history_visible(const struct history_entry *e, const char *viewer);
+/*按 viewer 看到的样子把消息格式化成 "#编号 内容\n"，返回长度*/
+int history_format(const struct history_entry *e, const char *viewer, char *buf, size_t size);
+void history_cleanup();
+
+// =============== compress.c: 压缩 ===============
+void codec_set(int fd, int codec);
+int codec_get(int fd);
+/*处理客户端的 "/codec 名字" 请求*/
+void codec_negotiate(int fd, const char *name);
+/*按 fd 协商的编码发送，cache 用于广播时复用压缩结果*/
+ssize_t codec_send(int fd, const char *buf, size_t len, struct codec_cache *cache);
+/*单个接收者的发送*/
+ssize_t chat_send(int fd, const char *buf, size_t len);
+
+// =============== session.c: 断线重连 ===============
+/*用户登录成功，签发新令牌，返回令牌*/
+const char *session_open(const char *name);
+/*凭令牌恢复会话，返回用户名，令牌无效或已过期返回NULL*/
+const char *session_resume(const char *token);
+/*用户断线，令牌保留 SESSION_TTL 秒*/
+void session_close(const char *name);
+/*取第 i 个有效会话，无效位置返回NULL*/
+struct session *session_get(int i);
+/*热重启时恢复一个会话*/
+void session_restore(const struct session *s);
+
+// =============== search.c: 倒排索引 ===============
+/*从 *p 开始取下一个词，写入 token，返回0表示没有更多的词*/
+int search_next_token(const char **p, char *token);
+void search_add(unsigned long seq, const char *text);
+void search_remove(unsigned long seq, const char *text);
+/*查找包含所有词的消息，最新的 max 条编号写入 out，返回写入的条数；*total 为匹配总数，提前停下时为-1*/
+int search_query(const char *query, unsigned long *out, int max, int *total);
+void search_cleanup();
+
+// =============== event.c: epoll反应堆 ===============
+/*初始化监听socket*/
+void initlistensocket(int ep_fd, unsigned short port);
+/*初始化本机 Unix socket 监听*/
+void initunixsocket(int ep_fd, const char *path, mode_t mode);
+/*退出时关闭 Unix socket 监听并删除路径*/
+void cleanup_unixsocket();
+/*把 uid 加入受信任列表，这些本机用户登录时只需用户名；超过 TRUSTED_UID_MAX 个返回-1*/
+int trust_uid(uid_t uid);
+/*将结构体成员变量初始化*/
+void eventset(struct my_events *my_ev, int fd, void (*call_back)(int fd, int event, void *arg), void *event_arg);
+/*向红黑树添加 文件描述符和对应的结构体*/
+void eventadd(int ep_fd, int event, struct my_events *my_ev);
+/*从红黑树上删除 文件描述符和对应的结构体*/
+void eventdel(int ep_fd, struct my_events *ev);
+/*发送数据*/
+void senddata(int client_fd, int event, void *arg);
+/*接收数据*/
+void recvdata(int client_fd, int event, void *arg);
+/*回调函数: 接收连接*/
+void acceptconnect(int listen_fd, int event, void *arg);
+/*把已建立的连接挂上红黑树等待登录，返回 ep_events 下标，没有空位返回-1*/
+int addconnection(int connect_fd, int trusted);
+/*等待 timeout 毫秒并分发就绪事件，返回处理的事件数，出错返回-1*/
+int eventdispatch(int ep_fd, int timeout);
+/*按用户名查找在线连接的fd，找不到返回-1*/
+int find_user_fd(const char *name);
+//清理资源的函数
+void cleanup_resources();
+
+// =============== capture.c: 流量录制 ===============
+/*开始录制到 path，失败返回-1*/
+int capture_open(const char *path);
+void capture_accept(int fd, int trusted);
+void capture_data(int fd, const char *buf, size_t len);
+void capture_close(int fd);
+void capture_cleanup();
+/*读下一条记录，返回1读到，0文件结束，-1格式错误*/
+int capture_next(FILE *fp, struct capture_record *rec, char *buf, size_t size);
+
+// =============== handoff.c: 热重启 ===============
+/*在 HANDOFF_PATH 上监听，等待新进程接手*/
+void handoff_listen();
+/*连接旧进程并接手它的全部状态，成功返回0*/
+int handoff_takeover();
+void handoff_cleanup();
+
+#endif
@@ -3,24 +3,256 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/socket.h>
-#include <sys/types.h> 
+#include <sys/types.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
 #include <ctype.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <locale.h>
+#include <zlib.h>
+#include "codec.h"
 
 #define SERVER_PORT 8000
+#define RECONNECT_TRIES 10   // 断线后重连的次数
+#define LINE_MAX_LEN 8192    // 控制行（以#开头）的最大长度
+#define FRAME_MAX_LEN 65536  // 压缩帧的最大长度
+
+int cfd = -1;
+pthread_mutex_t cfd_lock = PTHREAD_MUTEX_INITIALIZER; // 重连期间不让发送线程写入
+char session_token[64];      // 服务器签发的会话令牌，空表示还没登录
+unsigned long last_seq = 0;  // 收到的最后一条消息编号
+int want_deflate = 0;        // 命令行 -z: 请求服务器压缩
+int conn_codec = CODEC_NONE; // 当前连接实际采用的编码
+const char *unix_path = NULL; // 命令行 -u: 通过本机 Unix socket 连接
 
 void sys_error(const char* str){
     perror(str);
     exit(-1);
 }
 
+// 本机 Unix socket 连接，不经过 TCP 协议栈
+int connect_unix() {
+    int fd;
+    struct sockaddr_un addr;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, unix_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connect_server() {
+    int fd;
+    struct sockaddr_in server_addr;
+
+    if (unix_path != NULL) {
+        return connect_unix();
+    }
+
+    // 创建socket
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    // 设置服务器地址结构
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr.s_addr);
+
+    // 连接服务器
+    if (connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 登录前协商压缩，服务器回复 "#codec 名字" 之后的数据才按帧发送
+void negotiate_codec(int fd) {
+    char line[64];
+    size_t n = 0;
+    char c;
+
+    conn_codec = CODEC_NONE;
+    if (!want_deflate) {
+        return;
+    }
+    write(fd, "/codec deflate\n", 15);
+    while (n < sizeof(line) - 1 && read(fd, &c, 1) == 1 && c != '\n') {
+        line[n++] = c;
+    }
+    line[n] = '\0';
+    if (strcmp(line, "#codec deflate") == 0) {
+        conn_codec = CODEC_DEFLATE;
+    }
+}
+
+// 断线后带着令牌重连，服务器只补发缺失的消息；成功返回0
+int reconnect() {
+    char resume[128];
+    pthread_mutex_lock(&cfd_lock);
+    close(cfd);
+    for (int i = 1; i <= RECONNECT_TRIES; i++) {
+        printf("\n连接已断开，正在重连(%d/%d)...\n", i, RECONNECT_TRIES);
+        sleep(i < 5 ? i : 5);
+        if ((cfd = connect_server()) < 0) {
+            continue;
+        }
+        negotiate_codec(cfd);
+        snprintf(resume, sizeof(resume), "/resume %s %lu\n", session_token, last_seq);
+        write(cfd, resume, strlen(resume));
+        pthread_mutex_unlock(&cfd_lock);
+        printf("已重新连接\n");
+        return 0;
+    }
+    pthread_mutex_unlock(&cfd_lock);
+    return -1;
+}
+
+// 处理一行以#开头的控制消息
+void handle_control(char *line) {
+    char token[64];
+    unsigned long seq;
+    int n = 0;
+
+    if (sscanf(line, "#session %63s %lu", token, &seq) == 2) {
+        strcpy(session_token, token);
+        last_seq = seq;
+    } else if (strncmp(line, "#resume-failed", 14) == 0) {
+        session_token[0] = '\0';
+        printf("请登录：");
+        fflush(stdout);
+    } else if (sscanf(line, "#%lu %n", &seq, &n) == 1 && n > 0) {
+        // 带编号的消息，记下编号后显示内容
+        if (seq > last_seq) {
+            last_seq = seq;
+        }
+        write(STDOUT_FILENO, line + n, strlen(line + n));
+        write(STDOUT_FILENO, "\n", 1);
+    } else {
+        write(STDOUT_FILENO, line, strlen(line));
+        write(STDOUT_FILENO, "\n", 1);
+    }
+}
+
+// 按行处理服务器发来的数据：以#开头的行攒齐后解析，其他内容直接显示
+void handle_data(const char *buf, int n, int reset) {
+    static char line[LINE_MAX_LEN];
+    static int line_len = 0;
+    static int in_control = 0;   // 当前行是否是控制行
+    static int line_start = 1;   // 下一个字节是否是行首
+
+    if (reset) {  // 新连接从行首开始，旧连接断开时没收完的半行丢掉
+        line_len = 0;
+        line_start = 1;
+        return;
+    }
+    int start = 0;
+    for (int i = 0; i < n; i++) {
+        if (line_start) {
+            in_control = buf[i] == '#';
+            line_start = 0;
+            start = i;
+        }
+        if (buf[i] == '\n') {
+            line_start = 1;
+            if (in_control) {
+                line[line_len] = '\0';
+                handle_control(line);
+                line_len = 0;
+            } else {
+                write(STDOUT_FILENO, buf + start, i - start + 1);
+            }
+            continue;
+        }
+        if (in_control && line_len < LINE_MAX_LEN - 1) {
+            line[line_len++] = buf[i];
+        }
+    }
+    // 普通行没有换行结尾（如颜色重置码）也立即显示
+    if (!line_start && !in_control) {
+        write(STDOUT_FILENO, buf + start, n - start);
+    }
+}
+
+// 处理压缩连接上的数据：攒齐一帧后解压，再按普通数据处理
+void handle_frames(const char *buf, int n, int reset) {
+    static unsigned char frame[4 + FRAME_MAX_LEN];
+    static size_t have = 0;
+    static z_stream zs;
+    static int zs_ready = 0;
+    static char out[FRAME_MAX_LEN];
+
+    if (reset) {  // 新连接从帧边界开始
+        have = 0;
+        return;
+    }
+    if (!zs_ready) {
+        if (inflateInit2(&zs, -15) != Z_OK) {
+            sys_error("inflateInit2 error");
+        }
+        zs_ready = 1;
+    }
+
+    while (n > 0) {
+        // 先攒帧头，再攒数据
+        size_t need = 4;
+        if (have >= 4) {
+            uint32_t header = (frame[0] << 24) | (frame[1] << 16) | (frame[2] << 8) | frame[3];
+            need = 4 + (header & ~CODEC_FLAG_DEFLATE);
+            if (need > sizeof(frame)) {
+                fprintf(stderr, "frame too large\n");
+                exit(-1);
+            }
+        }
+        size_t take = need - have < (size_t)n ? need - have : (size_t)n;
+        memcpy(frame + have, buf, take);
+        have += take;
+        buf += take;
+        n -= take;
+        if (have < need) {
+            continue;
+        }
+        if (need == 4) {  // 刚攒齐帧头
+            if (((frame[0] & 0x7f) | frame[1] | frame[2] | frame[3]) == 0) {
+                have = 0;  // 空帧
+            }
+            continue;
+        }
+
+        uint32_t header = (frame[0] << 24) | (frame[1] << 16) | (frame[2] << 8) | frame[3];
+        if (!(header & CODEC_FLAG_DEFLATE)) {
+            handle_data((char *)frame + 4, need - 4, 0);
+        } else {
+            inflateReset(&zs);
+            inflateSetDictionary(&zs, (const Bytef *)CODEC_DICTIONARY, sizeof(CODEC_DICTIONARY) - 1);
+            zs.next_in = frame + 4;
+            zs.avail_in = need - 4;
+            zs.next_out = (Bytef *)out;
+            zs.avail_out = sizeof(out);
+            if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
+                fprintf(stderr, "inflate error\n");
+                exit(-1);
+            }
+            handle_data(out, sizeof(out) - zs.avail_out, 0);
+        }
+        have = 0;
+    }
+}
+
 // 添加一个线程函数来处理发送消息
 void* send_msg(void* arg) {
-    int cfd = *(int*)arg;
     char buf[BUFSIZ];
     while(1) {
         // 从标准输入读取消息
@@ -29,48 +261,59 @@ void* send_msg(void* arg) {
             continue;
         }
         // 发送给服务器
+        pthread_mutex_lock(&cfd_lock);
         write(cfd, buf, n);
+        pthread_mutex_unlock(&cfd_lock);
     }
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    int cfd;
-    struct sockaddr_in server_addr;
     char buf[BUFSIZ];
-    
-    // 创建socket
-    if ((cfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        sys_error("socket error");
+
+    signal(SIGPIPE, SIG_IGN); // 连接断开时写入不能杀掉进程
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-z") == 0) {
+            want_deflate = 1;
+        } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-z] [-u unix_path]\n", argv[0]);
+            exit(-1);
+        }
     }
-    
-    // 设置服务器地址结构
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr.s_addr);
-    
-    // 连接服务器
-    if (connect(cfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+
+    if ((cfd = connect_server()) < 0) {
         sys_error("connect error");
     }
+    negotiate_codec(cfd);
     printf("您已经成功连接服务器\n");
     printf("请登录：");
     fflush(stdout);
     // 创建发送消息的线程
     pthread_t tid;
-    pthread_create(&tid, NULL, send_msg, &cfd);
-    
+    pthread_create(&tid, NULL, send_msg, NULL);
+
     // 主线程负责接收消息
     while(1) {
         int n = read(cfd, buf, sizeof(buf));
         if (n <= 0) {  // 服务器关闭或出错
+            // 登录过的话带着令牌重连
+            if (session_token[0] != '\0' && reconnect() == 0) {
+                handle_frames(NULL, 0, 1);
+                handle_data(NULL, 0, 1);
+                continue;
+            }
             sys_error("server closed connection");
         }
         // 将接收到的消息写到标准输出
-        write(STDOUT_FILENO, buf, n);
+        if (conn_codec == CODEC_DEFLATE) {
+            handle_frames(buf, n, 0);
+        } else {
+            handle_data(buf, n, 0);
+        }
     }
-    
+
     close(cfd);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,31 @@
+#ifndef CODEC_H
+#define CODEC_H
+/*服务器和客户端共用的压缩协议
+  客户端登录前发送 "/codec deflate"，服务器回复 "#codec deflate" 后，
+  该连接上服务器发出的所有数据都按帧发送：4字节大端长度 + 数据
+  长度最高位为1表示数据经过 raw deflate 压缩（每帧独立压缩，使用下面的预置字典），
+  为0表示原样发送。每帧独立，所以一条广播对所有客户端只压缩一次*/
+
+#define CODEC_NONE    0
+#define CODEC_DEFLATE 1
+
+#define CODEC_FLAG_DEFLATE 0x80000000u // 帧长度最高位：已压缩
+#define CODEC_MIN_SIZE 32               // 比这短的消息不压缩
+#define CODEC_LEVEL 6                   // zlib 压缩级别
+
+/*预置字典：服务器消息中反复出现的片段，越常用的放得越靠后*/
+#define CODEC_DICTIONARY \
+   "#resume-failed\n#session #codec deflate\n" \
+   "会话已过期，请重新登录 错误: 登录格式不正确 用户不存在或密码错误 请勿重复登录 " \
+   "私聊格式不正确\n不能私信自己\n发送失败，对方可能已离线\n用户  不存在或已离线\n" \
+   "\n搜索 \": 共  条, 显示最近  条 ( ms)\n [" \
+   "\033[32m\033[1m\n当前在线人数:  人\n在线列表：\n - \n - \n - " \
+   "\n—————————————————————————————————————————————\033[0m\n" \
+   " 重新连接 ============= [在线人数: \033[0m\n" \
+   " 离开了聊天室 ============= [在线人数: \033[0m\n" \
+   "\033[35m你悄悄地对  说: \033[0m\n" \
+   "\033[35m 悄悄地对你说: \033[0m\n" \
+   " 加入聊天室 ============= [在线人数: \033[0m\n" \
+   "\033[32m\033[1m============= "
+
+#endif
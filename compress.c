@@ -0,0 +1,121 @@
+/*按连接协商的压缩：所有发给客户端的数据都经过 chat_send
+  每个连接的编码记在 conn_codec[fd]，广播时同一条消息只压缩一次*/
+#include "chat.h"
+#include <sys/uio.h>
+#include <zlib.h>
+
+static unsigned char conn_codec[CODEC_MAX_FD]; // fd -> CODEC_NONE / CODEC_DEFLATE
+static z_stream zs;
+static int zs_ready = 0;
+
+static const char *codec_names[] = {"none", "deflate"};
+
+void codec_set(int fd, int codec)
+{
+   if (fd >= 0 && fd < CODEC_MAX_FD)
+      conn_codec[fd] = codec;
+}
+
+int codec_get(int fd)
+{
+   if (fd < 0 || fd >= CODEC_MAX_FD)
+      return CODEC_NONE;
+   return conn_codec[fd];
+}
+
+/*客户端登录前发来 "/codec 名字"，回复实际采用的编码，回复本身不压缩*/
+void codec_negotiate(int fd, const char *name)
+{
+   char ack[32];
+   int codec = CODEC_NONE;
+
+   if (strcmp(name, "deflate") == 0 && fd < CODEC_MAX_FD)
+      codec = CODEC_DEFLATE;
+   codec_set(fd, CODEC_NONE);
+   snprintf(ack, sizeof(ack), "#codec %s\n", codec_names[codec]);
+   send(fd, ack, strlen(ack), 0);
+   codec_set(fd, codec);
+}
+
+/*把 buf 压缩成一帧写入 cache，压缩后不变小就原样成帧*/
+static void codec_encode(const char *buf, size_t len, struct codec_cache *cache)
+{
+   uint32_t header = len;
+
+   cache->ready = 1;
+   cache->data = (const unsigned char *)buf;
+   cache->len = len;
+
+   if (len < CODEC_MIN_SIZE || len > CODEC_PAYLOAD_MAX)
+      goto raw;
+
+   if (!zs_ready)
+   {
+      // raw deflate（windowBits 为负），帧里不需要 zlib 头
+      if (deflateInit2(&zs, CODEC_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+         goto raw;
+      zs_ready = 1;
+   }
+   else
+      deflateReset(&zs);
+   deflateSetDictionary(&zs, (const Bytef *)CODEC_DICTIONARY, sizeof(CODEC_DICTIONARY) - 1);
+
+   zs.next_in = (Bytef *)buf;
+   zs.avail_in = len;
+   zs.next_out = cache->frame;
+   zs.avail_out = len; // 压缩后不比原来小就没有意义
+   if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+      goto raw;
+
+   cache->data = cache->frame;
+   cache->len = len - zs.avail_out;
+   header = cache->len | CODEC_FLAG_DEFLATE;
+
+raw:
+   cache->header[0] = header >> 24;
+   cache->header[1] = header >> 16;
+   cache->header[2] = header >> 8;
+   cache->header[3] = header;
+}
+
+/*按 fd 协商的编码发送；cache 不为NULL时压缩结果缓存在里面，广播给多人时复用*/
+ssize_t codec_send(int fd, const char *buf, size_t len, struct codec_cache *cache)
+{
+   struct codec_cache local;
+
+   if (codec_get(fd) == CODEC_NONE)
+      return send(fd, buf, len, 0);
+
+   if (cache == NULL)
+   {
+      local.ready = 0;
+      cache = &local;
+   }
+   if (!cache->ready)
+      codec_encode(buf, len, cache);
+
+   // 帧头和数据一次系统调用发出
+   struct iovec iov[2] = {{cache->header, 4}, {(void *)cache->data, cache->len}};
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = iov;
+   msg.msg_iovlen = 2;
+   ssize_t n = sendmsg(fd, &msg, 0);
+   if (n >= 0 && (size_t)n < 4 + cache->len)
+   {
+      /*非阻塞socket缓冲区满时只写出了半帧，后面的帧客户端都会解错
+        只能断开：这里不能 close（广播还在遍历），shutdown 后 recvdata 读到0按正常断开处理，
+        客户端凭令牌重连，缺的消息由断线重连补发*/
+      printf("short frame on fd[%d] (%zd/%zu), disconnecting\n", fd, n, 4 + cache->len);
+      shutdown(fd, SHUT_RDWR);
+      errno = EPIPE;
+      return -1;
+   }
+   return n;
+}
+
+/*单个接收者的发送*/
+ssize_t chat_send(int fd, const char *buf, size_t len)
+{
+   return codec_send(fd, buf, len, NULL);
+}
@@ -0,0 +1,682 @@
+#define _GNU_SOURCE // struct ucred
+#include "chat.h"
+#include <sys/un.h>
+#include <sys/stat.h>
+
+volatile sig_atomic_t server_running = 1;
+int ep_fd;                              // 红黑树根（epoll_create返回的句柄）
+struct my_events ep_events[MAX_EVENTS]; // 定义于任何函数体之外的变量被初始化为0（bss段）
+
+static uid_t trusted_uids[TRUSTED_UID_MAX]; // 从 Unix socket 连进来时免密码登录的 uid
+static int trusted_count = 0;
+
+//清理资源的函数
+void cleanup_resources() {
+   printf("Starting cleanup...\n");
+    
+   if (client_list == NULL) {
+      printf("Client list is already NULL\n");
+      return;
+   }
+    
+   // 1. 先关闭所有客户端连接
+   struct client_node *curr = client_list->next;
+   while (curr != NULL) {
+      // 保存下一个节点的指针，因为当前节点即将被关闭
+      struct client_node *next = curr->next;
+        
+      // 给客户端发送服务器关闭消息（热重启时连接已交给新进程，不能通知）
+      if (!handed_off) {
+         char shutdown_msg[] = "Server is shutting down. Goodbye!\n";
+         chat_send(curr->user.fd, shutdown_msg, strlen(shutdown_msg));
+      }
+        
+      // 关闭socket
+      close(curr->user.fd);
+        
+      // 从epoll中移除
+      for (int i = 0; i < MAX_EVENTS; i++) {
+            if (ep_events[i].m_status == 1 && ep_events[i].m_fd == curr->user.fd) {
+               eventdel(ep_fd, &ep_events[i]);
+               break;
+            }
+         }
+        curr = next;
+      }
+    
+    // 2. 然后释放链表内存
+    cleanup_client_list();
+    client_list = NULL;  // 防止重复释放
+    
+    // 3. 最后关闭epoll描述符
+    if (ep_fd > 0) {
+        close(ep_fd);
+        ep_fd = -1;  // 防止重复关闭
+    }
+    
+    printf("Cleanup complete.\n");
+}
+
+/*初始化监听socket*/
+void initlistensocket(int ep_fd, unsigned short port)
+{
+   int listen_fd;
+   struct sockaddr_in listen_socket_addr;
+
+   // printf("\n initlistensocket() \n");
+
+   /*申请一个socket*/
+   listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+   fcntl(listen_fd, F_SETFL, O_NONBLOCK); // 将socket设置为非阻塞模式
+   /*使I/O变成非阻塞模式(non-blocking)，在读取不到数据或是写入缓冲区已满会马上return，而不会阻塞等待。*/
+   int opt = 1;
+   setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)); // 设置为可以端口复用
+   /*SO_REUSEADDR：（这通常是重启监听服务器时出现，若不设置此选项，则bind时将出错。）
+     SOL_SOCKET：To manipulate options at the sockets API level, level is  specified  as  SOL_SOCKET.*/
+
+   /*绑定前初始化*/
+   bzero(&listen_socket_addr, sizeof(listen_socket_addr));
+   listen_socket_addr.sin_family = AF_INET;
+   listen_socket_addr.sin_port = htons(port);
+   listen_socket_addr.sin_addr.s_addr = inet_addr("0.0.0.0");
+   /*绑定*/
+   bind(listen_fd, (struct sockaddr *)&listen_socket_addr, sizeof(listen_socket_addr));
+   /*设置监听上限*/
+   listen(listen_fd, 128);
+
+   /*将listen_fd初始化*/
+   eventset(&ep_events[MAX_EVENTS - 1], listen_fd, acceptconnect, &ep_events[MAX_EVENTS - 1]);
+   /*将listen_fd挂上红黑树*/
+   eventadd(ep_fd, EPOLLIN, &ep_events[MAX_EVENTS - 1]);
+
+   return;
+}
+
+/*初始化本机 Unix socket 监听，和 TCP 监听共用 acceptconnect
+  同一台机器上的机器人走这里，省掉 TCP 回环协议栈*/
+void initunixsocket(int ep_fd, const char *path, mode_t mode)
+{
+   int listen_fd;
+   struct sockaddr_un addr;
+
+   if (strlen(path) >= sizeof(addr.sun_path))
+   {
+      printf("unix socket path too long: %s\n", path);
+      return;
+   }
+   if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+   {
+      perror("unix socket error");
+      return;
+   }
+   fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+   unlink(path); // 上一个进程留下的路径
+   // 连接 Unix socket 需要写权限，默认的 umask 会让其他用户下的机器人连不上
+   if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path, mode) < 0 || listen(listen_fd, 128) < 0)
+   {
+      perror("unix socket bind error");
+      close(listen_fd);
+      return;
+   }
+
+   eventset(&ep_events[UNIX_LISTEN_SLOT], listen_fd, acceptconnect, &ep_events[UNIX_LISTEN_SLOT]);
+   eventadd(ep_fd, EPOLLIN, &ep_events[UNIX_LISTEN_SLOT]);
+}
+
+/*退出时删除 Unix socket 路径；热重启时监听socket已交给新进程，路径要留着*/
+void cleanup_unixsocket()
+{
+   struct my_events *ev = &ep_events[UNIX_LISTEN_SLOT];
+   struct sockaddr_un addr;
+   socklen_t len = sizeof(addr);
+
+   if (handed_off || ev->m_status != 1 || ev->call_back != acceptconnect)
+      return;
+   eventdel(ep_fd, ev);
+   if (getsockname(ev->m_fd, (struct sockaddr *)&addr, &len) == 0 && addr.sun_path[0] != '\0')
+      unlink(addr.sun_path);
+   close(ev->m_fd);
+}
+
+/*列表已满返回-1*/
+int trust_uid(uid_t uid)
+{
+   if (trusted_count >= TRUSTED_UID_MAX)
+      return -1;
+   trusted_uids[trusted_count++] = uid;
+   return 0;
+}
+
+/*Unix socket 连接：用 SO_PEERCRED 取对端进程的 uid，在受信任列表里返回1*/
+static int peer_trusted(int fd)
+{
+   struct ucred cred;
+   socklen_t len = sizeof(cred);
+
+   if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+      return 0;
+   printf("client connected unix pid:%d uid:%d\n", (int)cred.pid, (int)cred.uid);
+   for (int i = 0; i < trusted_count; i++)
+      if (trusted_uids[i] == cred.uid)
+         return 1;
+   return 0;
+}
+
+/*将结构体成员变量初始化*/
+void eventset(struct my_events *my_ev, int fd, void (*call_back)(int, int, void *), void *event_arg)
+{
+   my_ev->m_fd = fd;
+   my_ev->m_event = 0;       // 开始不知道关注的是什么事件，因此设置为0
+   my_ev->m_arg = event_arg; // 指向自己
+   my_ev->call_back = call_back;
+
+   if (my_ev->m_id[0] == '\0') {
+      strcpy(my_ev->m_id, "NULL");
+   }
+   my_ev->m_status = 0;            // 0表示没有在红黑树上
+   my_ev->m_lasttime = time(NULL); // 调用eventset函数的绝对时间
+   return;
+}
+
+/*向红黑树添加文件描述符和对应的结构体*/
+void eventadd(int ep_fd, int event, struct my_events *my_ev)
+{
+   int op;
+   struct epoll_event epv;
+   epv.data.ptr = my_ev;                // 让events[i].data.ptr指向我们初始化后的my_events，在注册的时候决定的，等到事件为激活态的时候，再将ptr的内容取出，进行比较，回调即可。
+   epv.events = my_ev->m_event = event; // EPOLLIN或EPOLLOUT，默认LT 此处修改成ET
+
+   if (my_ev->m_status == 0)
+   {
+      op = EPOLL_CTL_ADD;
+   }
+   else
+   {
+      printf("\n add error: already on tree \n");
+      return;
+   }
+
+   if (epoll_ctl(ep_fd, op, my_ev->m_fd, &epv) < 0) // 实际添加/修改
+   {
+      perror("epoll_ctl error");
+      // printf("\n event add/mod false [fd= %d] [events= %d] \n", my_ev->m_fd, my_ev->m_event);
+   }
+   else
+   {
+      my_ev->m_status = 1;
+      // printf("\n event add ok [fd= %d] [events= %d] \n", my_ev->m_fd, my_ev->m_event);
+   }
+
+   return;
+}
+/*从红黑树上删除 文件描述符和对应的结构体*/
+void eventdel(int ep_fd, struct my_events *ev)
+{
+   if (ev->m_status != 1)
+      return;
+
+   epoll_ctl(ep_fd, EPOLL_CTL_DEL, ev->m_fd, NULL);
+   ev->m_status = 0;
+
+   return;
+}
+
+/*回调函数: 接收连接*/
+void acceptconnect(int listen_fd, int event, void *arg)
+{
+   int connect_fd;
+   char client_ip[32];
+   struct sockaddr_storage connect_socket_addr; // TCP 或 Unix socket 监听都走这里
+   socklen_t connect_socket_len; // a value-result argument
+   /*the caller must initialize it  to  contain the  size (in bytes) of the structure pointed to by addr;
+    on return it will contain the actual size of the peer address.*/
+   connect_socket_len = sizeof(connect_socket_addr);
+   if ((connect_fd = accept(listen_fd, (struct sockaddr *)&connect_socket_addr, &connect_socket_len)) < 0)
+   /*addrlen不能用&+sizeof来获取，sizeof表达式的结果是一个unsigned的纯右值，无法对其引用。
+   主要原因__addr_len是一个传入传出参数*/
+   {
+      if (errno != EAGAIN && errno != EINTR)
+      { /*暂时不处理*/
+      }
+
+      return;
+   }
+
+   addconnection(connect_fd, connect_socket_addr.ss_family == AF_UNIX && peer_trusted(connect_fd));
+
+   if (connect_socket_addr.ss_family == AF_INET)
+   {
+      struct sockaddr_in *in = (struct sockaddr_in *)&connect_socket_addr;
+      printf("client connected ip: %s port:%d\n", inet_ntop(AF_INET, (const void *)&in->sin_addr.s_addr, client_ip, sizeof(client_ip)), ntohs(in->sin_port));
+   }
+
+   return;
+}
+
+/*把已建立的连接挂上红黑树等待登录，acceptconnect 和 chat_replay 共用
+  返回 ep_events 下标，没有空位或出错返回-1*/
+int addconnection(int connect_fd, int trusted)
+{
+   int i; // 标识ep_events数组下标
+
+   for (i = 0; i < UNIX_LISTEN_SLOT; i++) // 从全局数组ep_events中找一个空闲位置i(类似于select中找值为-1的位置)，末尾几个留给监听socket
+      if (ep_events[i].m_status == 0)
+         break;
+   if (i >= UNIX_LISTEN_SLOT)
+   {
+      printf("\n %s : max connect [%d] \n", __func__, MAX_EVENTS);
+      close(connect_fd);
+      return -1;
+   }
+
+   /* 设置非阻塞 */
+   if (fcntl(connect_fd, F_SETFL, O_NONBLOCK) < 0)
+   {
+      perror("fcntl NONBLOCK error");
+      close(connect_fd); // 关闭连接
+      return -1;
+   }
+
+   codec_set(connect_fd, CODEC_NONE); // 新连接默认不压缩，fd 可能是复用的
+   eventset(&ep_events[i], connect_fd, recvdata, &ep_events[i]);
+   ep_events[i].m_trusted = trusted;
+   eventadd(ep_fd, EPOLLIN | EPOLLET, &ep_events[i]);
+   capture_accept(connect_fd, trusted);
+   return i;
+}
+
+/*等待 timeout 毫秒并分发就绪事件，server 主循环和 chat_replay 共用
+  返回处理的事件数，epoll_wait 出错返回-1*/
+int eventdispatch(int ep_fd, int timeout)
+{
+   struct epoll_event events[MAX_EVENTS]; // epoll_wait的传出参数(数组：保存就绪事件的文件描述符)
+   int i;
+
+   /*监听红黑树,将满足条件的文件描述符加至ep_events数组*/
+   int n_ready = epoll_wait(ep_fd, events, MAX_EVENTS, timeout);
+   if (n_ready < 0) // EINTR：interrupted system call
+      return errno == EINTR ? 0 : -1;
+
+   for (i = 0; i < n_ready && server_running; i++) // 交接完成后剩下的事件留给新进程
+   {
+      // 将传出参数events[i].data的ptr赋值给"自定义结构体ev指针"
+      struct my_events *ev = (struct my_events *)(events[i].data.ptr);
+      if ((events[i].events & EPOLLIN) && (ev->m_event & EPOLLIN)) // 读就绪事件
+         ev->call_back(ev->m_fd, events[i].events, ev->m_arg);
+      if ((events[i].events & EPOLLOUT) && (ev->m_event & EPOLLOUT)) // 写就绪事件
+         ev->call_back(ev->m_fd, events[i].events, ev->m_arg);
+   }
+   return n_ready;
+}
+
+/*把令牌和客户端已经收到的最后编号发给客户端，客户端重连时带上*/
+static void send_session(struct my_events *ev, const char *token, unsigned long last)
+{
+   char session_msg[64];
+   snprintf(session_msg, sizeof(session_msg), "#session %s %lu\n", token, last);
+   chat_send(ev->m_fd, session_msg, strlen(session_msg));
+}
+
+/*断线重连: m_buf 为 "/resume 令牌 编号"，补发编号之后的消息并恢复登录状态*/
+static void resume_session(struct my_events *ev)
+{
+   char token[SESSION_TOKEN_LEN + 1];
+   char msg[BUFSIZ];
+   unsigned long seen, first, last;
+   const char *name;
+
+   if(sscanf(ev->m_buf + 8, "%16s %lu", token, &seen) != 2 || (name = session_resume(token)) == NULL){
+      snprintf(msg, sizeof(msg), "#resume-failed\n%s%s会话已过期，请重新登录%s\n",COLOR_GREEN,STYLE_BOLD,COLOR_RESET);
+      chat_send(ev->m_fd, msg, strlen(msg));
+      return;
+   }
+
+   // 旧连接可能还没被发现断开，直接顶掉，不广播离开和加入
+   int kicked = 0;
+   for(int i = 0; i < MAX_EVENTS; i++){
+      struct my_events *old = &ep_events[i];
+      if(old != ev && old->m_status == 1 && strcmp(old->m_id, name) == 0){
+         eventdel(ep_fd, old);
+         client_list_delete(old->m_fd);
+         close(old->m_fd);
+         strcpy(old->m_id, "NULL");
+         online_count--;
+         kicked = 1;
+      }
+   }
+
+   strcpy(ev->m_id, name);
+   online_count++;
+   client_list_add(ev->m_fd, ev->m_id);
+
+   // 补发缺失的消息，太多时只补最近的 RESUME_REPLAY_MAX 条
+   history_range(&first, &last);
+   unsigned long from = seen + 1;
+   if(last >= RESUME_REPLAY_MAX && from < last - RESUME_REPLAY_MAX + 1)
+      from = last - RESUME_REPLAY_MAX + 1;
+   if(from < first)
+      from = first;
+   if(from > seen + 1){
+      snprintf(msg, sizeof(msg), "%s%s断线期间的 %lu 条消息已过期，只补发最近的部分%s\n",
+               COLOR_GREEN,STYLE_BOLD, from - seen - 1, COLOR_RESET);
+      chat_send(ev->m_fd, msg, strlen(msg));
+   }
+   // 发送失败（缓冲区满）就停下，#session 里只报告真正送到的编号
+   // 之后的广播会让客户端的编号越过缺口，所以还要断开，客户端重连时从送到的地方接着补
+   unsigned long delivered = seen;
+   for(unsigned long seq = from; seq <= last; seq++){
+      struct history_entry *e = history_get(seq);
+      if(history_visible(e, ev->m_id)){
+         int len = history_format(e, ev->m_id, msg, sizeof(msg));
+         ssize_t n = chat_send(ev->m_fd, msg, len);
+         if(n != len){
+            printf("Client[%d] replay stopped at #%lu\n", ev->m_fd, seq);
+            break;
+         }
+      }
+      delivered = seq;
+   }
+   send_session(ev, token, delivered);
+   if(delivered < last)
+      shutdown(ev->m_fd, SHUT_RDWR); // recvdata 读到0后按正常断开处理
+
+   if(!kicked){
+      snprintf(msg, sizeof(msg),
+         "%s%s============= %s 重新连接 ============= [在线人数: %d]%s",
+            COLOR_GREEN,  STYLE_BOLD,  ev->m_id, online_count,COLOR_RESET);
+      broadcast_notice(ev, msg);
+   }
+   printf("Client[%d] resumed session of %s from #%lu\n", ev->m_fd, ev->m_id, seen);
+}
+
+/*接收数据*/
+void recvdata(int client_fd, int event, void *arg)
+{
+   struct my_events *ev = (struct my_events *)arg;
+   // 先从树上摘下
+   eventdel(ep_fd, ev);
+   int total_read = 0;
+
+   while (1)
+   {
+      // 确保不会缓冲区溢出
+      int remaining = sizeof(ev->m_buf) - total_read - 1; // 预留一个字节给'\0'
+      if (remaining <= 0)
+      {
+         printf("Buffer full, total_read: %d\n", total_read);
+         break;
+      }
+
+      int len = recv(client_fd, ev->m_buf + total_read, remaining, 0);
+      if (len == 0) // 对端关闭连接
+      {
+         char leave_msg[BUFSIZ];
+         capture_close(client_fd);
+         
+         if(strcmp(ev->m_id,"NULL") != 0){
+            online_count--;
+            client_list_delete(client_fd);
+            session_close(ev->m_id); // 令牌保留一段时间，等待断线重连
+            snprintf(leave_msg, sizeof(leave_msg),
+                  "%s%s============= %s 离开了聊天室 ============= [在线人数: %d]%s",
+                  COLOR_GREEN,STYLE_BOLD,
+                  ev->m_id, online_count, COLOR_RESET);
+            broadcast_notice(ev, leave_msg);
+            strcpy(ev->m_id, "NULL");
+            printf("Client[%d] closed connection\n", client_fd);
+         }
+
+         close(client_fd);
+         return;
+      }
+      else if (len < 0)
+      {
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+         {
+            // 数据读取完毕（非阻塞模式下暂时没有更多数据可读）
+            if (total_read > 0)
+            {
+               // 处理接收到的数据
+               ev->m_buf[total_read] = '\0';
+               ev->m_buf_len = total_read;
+               capture_data(client_fd, ev->m_buf, total_read); // 录下这一批，回放时一次写入
+               printf("Received from client[%d]: %s", client_fd, ev->m_buf);
+
+               // 检查是否是第一条消息（设置ID）
+               if (strcmp(ev->m_id, "NULL") == 0)
+               {
+                  char login_name[32];
+                  char login_password[32];
+
+                  // 去掉消息中的换行符
+                  ev->m_buf[strcspn(ev->m_buf, "\n")] = '\0';
+                  //ev->m_buf[sizeof(ev->m_id) - 1] = '\0';
+
+                  // 协商压缩: "/codec deflate"，登录前发送
+                  if(strncmp(ev->m_buf, "/codec ", 7) == 0){
+                     codec_negotiate(client_fd, ev->m_buf + 7);
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     return;
+                  }
+
+                  // 断线重连: "/resume 令牌 最后收到的编号"
+                  if(strncmp(ev->m_buf, "/resume ", 8) == 0){
+                     resume_session(ev);
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     return;
+                  }
+
+                  char *password = login_password;
+                  int ret = login_str(ev->m_buf, login_name, login_password, sizeof(login_name), sizeof(login_password));
+                  // 受信任的本机用户只发用户名，不检查密码
+                  if(ret == -1 && ev->m_trusted && sscanf(ev->m_buf, "%31s", login_name) == 1){
+                     password = NULL;
+                     ret = 0;
+                  }
+                  if(ret == -1){
+                     char error_msg[128];
+                     snprintf(error_msg, sizeof(error_msg),
+                        "%s错误: 登录格式不正确%s%s\n",COLOR_GREEN,STYLE_BOLD,COLOR_RESET);
+                     chat_send(client_fd, error_msg, strlen(error_msg));
+                     // 继续监听新的ID输入
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     return;
+                  }
+
+                  if(verify_user(login_name, password) == 0){
+                     char error_msg[64];
+                     snprintf(error_msg, sizeof(error_msg),
+                        "%s错误: 用户不存在或密码错误%s\n",COLOR_GREEN,STYLE_BOLD);
+                     chat_send(client_fd, error_msg, strlen(error_msg));//ID已经存在
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     return;   
+                  }
+                  
+                  if(id_exists(login_name)){
+                     char error_msg[64];
+                     snprintf(error_msg, sizeof(error_msg),
+                        "%s错误: 请勿重复登录%s\n",COLOR_GREEN,STYLE_BOLD);
+                     chat_send(client_fd, error_msg, strlen(error_msg));//ID已经存在
+                     // 继续监听新的ID输入
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     return;
+                  }
+
+                  // 设置ID
+                  strncpy(ev->m_id,login_name, sizeof(login_name) - 1);
+                  ev->m_id[sizeof(ev->m_id) - 1] = '\0';
+
+                  // 广播加入消息
+                  char join_msg[BUFSIZ];
+                  online_count++;
+                  client_list_add(client_fd,ev->m_id);
+                  snprintf(join_msg, sizeof(join_msg),
+                     "%s%s============= %s 加入聊天室 ============= [在线人数: %d]%s",
+                        COLOR_GREEN,  STYLE_BOLD,  ev->m_id, online_count,COLOR_RESET);
+                  broadcast_notice(ev, join_msg);
+                  unsigned long first, last;
+                  history_range(&first, &last);
+                  send_session(ev, session_open(ev->m_id), last);
+
+                  // 重新设置为接收模式
+                  eventset(ev, client_fd, recvdata, ev);
+                  eventadd(ep_fd, EPOLLIN, ev);
+               }
+               else if(strncmp(ev->m_buf, "@",1) == 0){//处理私聊消息
+                  char send_name[32];
+                  int send_fd = -1;
+                  char *msg_content = NULL;
+
+                  //解析用户名和消息内容
+                  msg_content = parse_private(ev->m_buf, send_name, sizeof(send_name));
+                  if(msg_content == NULL){// 
+                     char error_msg[64] = {0};
+                     snprintf(error_msg, sizeof(error_msg), "私聊格式不正确\n");
+                     chat_send(ev->m_fd, error_msg, strlen(error_msg));
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     break;
+                  }
+                  send_fd = find_user_fd(send_name);
+
+                  if(send_fd < 0){
+                     
+                     char error_msg[64] = {0};
+                     snprintf(error_msg, sizeof(error_msg), "用户 %s 不存在或已离线\n", send_name);
+                     chat_send(ev->m_fd, error_msg, strlen(error_msg));
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     break;
+                  }
+
+                  if(ev->m_fd == send_fd){
+                     char error_msg[64] = {0};
+                     snprintf(error_msg, sizeof(error_msg), "不能私信自己\n");
+                     chat_send(ev->m_fd, error_msg, strlen(error_msg));
+                     eventset(ev, client_fd, recvdata, ev);
+                     eventadd(ep_fd, EPOLLIN, ev);
+                     break;
+                  }
+
+                  // 5. 发送私信，和广播共用编号并存入聊天记录
+                  char private_message[BUFSIZ] = {0};
+                  char confirm_message[BUFSIZ] = {0};
+                  struct history_entry *e = history_get(history_add(ev->m_id, send_name, msg_content));
+    
+                  // 给接收者的消息
+                  history_format(e, send_name, private_message, sizeof(private_message));
+    
+                  // 给发送者的确认消息
+                  history_format(e, ev->m_id, confirm_message, sizeof(confirm_message));
+    
+                  // 发送消息
+                  if(chat_send(send_fd, private_message, strlen(private_message)) < 0) {
+                     char error_msg[64] = {0};
+                     snprintf(error_msg, sizeof(error_msg), "发送失败，对方可能已离线\n");
+                     chat_send(ev->m_fd, error_msg, strlen(error_msg));
+                  } else {
+                  // 发送成功确认给发送者
+                  chat_send(ev->m_fd, confirm_message, strlen(confirm_message));
+                  }
+                  // 重新设置为接收模式
+                  eventset(ev, client_fd, recvdata, ev);
+                  eventadd(ep_fd, EPOLLIN, ev);
+
+               }else if(strncmp(ev->m_buf, "/list",5) == 0){
+                  list_online(client_fd);
+                  eventset(ev, client_fd, recvdata, ev);
+                  eventadd(ep_fd, EPOLLIN, ev);
+               }else if(strncmp(ev->m_buf, "/search",7) == 0){
+                  search_messages(client_fd, ev->m_buf + 7);
+                  eventset(ev, client_fd, recvdata, ev);
+                  eventadd(ep_fd, EPOLLIN, ev);
+               }
+               else{
+                  // 处理普通消息
+                  // 去掉结尾的换行后存入聊天记录
+                  size_t text_len = strlen(ev->m_buf);
+                  while(text_len > 0 && (ev->m_buf[text_len - 1] == '\n' || ev->m_buf[text_len - 1] == '\r'))
+                     text_len--;
+                  ev->m_buf[text_len] = '\0';
+                  unsigned long seq = history_add(ev->m_id, "", ev->m_buf);
+
+                  // 广播的内容为 "#编号 用户名: 消息"
+                  ev->m_buf_len = history_format(history_get(seq), ev->m_id, ev->m_buf, sizeof(ev->m_buf));
+
+                  // 切换到发送模式
+                  eventset(ev, client_fd, senddata, ev);
+                  eventadd(ep_fd, EPOLLOUT, ev);
+               }
+            }
+            else
+            {
+               // 没有读到数据，继续监听读事件
+               eventset(ev, client_fd, recvdata, ev);
+               eventadd(ep_fd, EPOLLIN, ev);
+            }
+            break; // 退出读取循环
+         }
+         else if (errno == EINTR)
+         {
+            // 被信号中断，继续读取
+            continue;
+         }
+         else
+         {
+            // 其他错误
+            printf("recv error on fd[%d]: %s\n", client_fd, strerror(errno));
+            capture_close(client_fd);
+            if(strcmp(ev->m_id,"NULL") != 0)
+               session_close(ev->m_id);
+            client_list_delete(client_fd);
+            online_count--;
+            close(client_fd);
+            return;
+         }
+      }
+      else
+      { // len > 0
+         total_read += len;
+         // 如果缓冲区已满，停止读取
+         if (total_read >= sizeof(ev->m_buf) - 1)
+         {
+            printf("Buffer full, total_read: %d\n", total_read);
+            break;
+         }
+      }
+   }
+}
+
+/*发送数据*/
+void senddata(int client_fd, int event, void *arg)
+{
+   struct my_events *ev = (struct my_events *)arg;
+   broadcast(ev, ev->m_buf);
+   // printf("-----\n");
+   eventdel(ep_fd, ev);                   // 1.将ev对应的文件描述符和结构体从红黑树拿下
+   eventset(ev, client_fd, recvdata, ev); // 2.设置client_fd对应的回调函数为recvdata
+   eventadd(ep_fd, EPOLLIN, ev);          // 3.将ev对应的文件描述符和结构体放上红黑树,监听读事件EPOLLIN
+   // printf("-----\n");
+
+   return;
+}
+
+/*按用户名查找在线连接的fd，找不到返回-1*/
+int find_user_fd(const char *name)
+{
+   for(int i = 0; i < MAX_EVENTS; i++){
+      if(ep_events[i].m_fd > 0 && (strcmp(name, ep_events[i].m_id) == 0)){
+         return ep_events[i].m_fd;
+      }
+   }
+   return -1;
+}
@@ -0,0 +1,715 @@
+/*热重启：新进程通过 Unix socket 从旧进程接手监听socket、所有客户端连接和会话状态
+  文件描述符用 SCM_RIGHTS 传递，其余状态（聊天记录、会话令牌）序列化成带标签的字段
+  第一条记录是 HELLO（魔数和版本），没有 HELLO 的是直接传结构体的版本1，仍然可以接手
+  启动新版本: ./server --takeover，旧进程交接完成后退出，客户端连接不断开*/
+#define _GNU_SOURCE // struct ucred
+#include "chat.h"
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <stddef.h>
+
+#define HANDOFF_ACK_TIMEOUT 10        // 等待新进程确认的秒数
+#define HANDOFF_MAGIC "CHATHOFF"
+#define HANDOFF_VERSION 2             // 1: 没有 HELLO 记录、直接传结构体的旧版本
+#define HANDOFF_RECORD_MAX (64 * 1024) // 一条记录数据的最大长度
+
+enum handoff_kind
+{
+   HANDOFF_LISTEN = 1, // 监听socket，带fd
+   HANDOFF_CLIENT,     // 客户端连接，带fd
+   HANDOFF_HISTORY,    // 聊天记录
+   HANDOFF_SESSION,    // 会话令牌
+   HANDOFF_END,        // 结束
+   HANDOFF_HELLO,      // 第一条记录：魔数和版本
+};
+
+/*记录的数据是一串字段: 标签(1字节) + 长度(4字节) + 内容
+  不认识的字段跳过，缺少的字段取默认值，新旧版本之间可以互相交接
+  编号只能追加，不能修改或复用*/
+enum handoff_field
+{
+   F_MAGIC = 1, F_VERSION,                     // HELLO
+   F_SLOT,                                     // LISTEN: 在 ep_events 中的位置
+   F_ID, F_PENDING, F_CODEC, F_TRUSTED, F_BUF, // CLIENT
+   F_SEQ, F_TIME, F_FROM, F_TO, F_TEXT,        // HISTORY，F_SEQ 开始一条新记录
+   F_TOKEN, F_NAME, F_EXPIRE,                  // SESSION，F_TOKEN 开始一个新会话
+};
+
+struct handoff_header
+{
+   int kind;
+   int len; // 后面跟着的数据长度
+};
+
+struct record
+{
+   char data[HANDOFF_RECORD_MAX];
+   size_t len;
+};
+
+/*客户端连接的状态，旧版本缺少的字段保持默认值*/
+struct client_state
+{
+   char id[32];
+   int pending;     // 1: m_buf 中有等待广播的消息（senddata 状态）
+   int codec;
+   int trusted;
+   const char *buf;
+   int buf_len;
+};
+
+/*版本1的结构体布局，最后一个 int 都是后面跟着的数据长度*/
+struct legacy_layout
+{
+   int size;        // 结构体大小
+   int codec_off;   // 没有这个字段为-1
+   int trusted_off;
+};
+static const struct legacy_layout legacy_clients[] = {
+   {48, 36, 40},    // id, pending, codec, trusted, buf_len
+   {44, 36, -1},    // id, pending, codec, buf_len
+   {40, -1, -1},    // id, pending, buf_len
+};
+struct legacy_history // 时间、来源之后有 to 的版本；最早的版本没有 to，大小 56
+{
+   unsigned long seq;
+   time_t time;
+   char from[32];
+   char to[32];
+   int text_len;
+};
+#define LEGACY_HISTORY_NO_TO 56
+
+int handed_off = 0; // 1: 状态已经交给新进程，退出时不能通知客户端
+
+//=============== 读写 ===============
+static int write_full(int sock, const void *buf, size_t len)
+{
+   const char *p = buf;
+   while (len > 0)
+   {
+      ssize_t n = send(sock, p, len, MSG_NOSIGNAL); // 新进程中途退出时不能让 SIGPIPE 杀掉旧进程
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      p += n;
+      len -= n;
+   }
+   return 0;
+}
+
+static int read_full(int sock, void *buf, size_t len)
+{
+   char *p = buf;
+   while (len > 0)
+   {
+      ssize_t n = read(sock, p, len);
+      if (n == 0)
+         return -1;
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      p += n;
+      len -= n;
+   }
+   return 0;
+}
+
+/*发送一条记录: 头部(可附带一个fd) + 两段数据*/
+static int send_record(int sock, int kind, int fd, const void *data, int len, const void *extra, int extra_len)
+{
+   struct handoff_header h = {kind, len + extra_len};
+   struct iovec iov = {&h, sizeof(h)};
+   char control[CMSG_SPACE(sizeof(int))];
+   struct msghdr msg;
+
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   if (fd >= 0)
+   {
+      memset(control, 0, sizeof(control));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+   }
+   // 头部只有8个字节，阻塞的 Unix socket 上一次就能发完
+   while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+      if (errno != EINTR)
+         return -1;
+   if (len > 0 && write_full(sock, data, len) < 0)
+      return -1;
+   if (extra_len > 0 && write_full(sock, extra, extra_len) < 0)
+      return -1;
+   return 0;
+}
+
+/*接收一条记录，数据写入 buf，附带的fd写入 *fd（没有则为-1）*/
+static int recv_record(int sock, struct handoff_header *h, int *fd, void *buf, size_t size)
+{
+   struct iovec iov = {h, sizeof(*h)};
+   char control[CMSG_SPACE(sizeof(int))];
+   struct msghdr msg;
+   ssize_t n;
+
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+   while ((n = recvmsg(sock, &msg, MSG_WAITALL)) < 0 && errno == EINTR)
+      ;
+   if (n != sizeof(*h) || h->len < 0 || (size_t)h->len > size)
+      return -1;
+
+   *fd = -1;
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+
+   return read_full(sock, buf, h->len);
+}
+
+//=============== 字段 ===============
+static void put_field(struct record *r, int tag, const void *data, uint32_t n)
+{
+   r->data[r->len++] = tag;
+   memcpy(r->data + r->len, &n, sizeof(n));
+   r->len += sizeof(n);
+   memcpy(r->data + r->len, data, n);
+   r->len += n;
+}
+
+static void put_int(struct record *r, int tag, int64_t v)
+{
+   put_field(r, tag, &v, sizeof(v));
+}
+
+static void put_str(struct record *r, int tag, const char *str)
+{
+   put_field(r, tag, str, strlen(str));
+}
+
+/*对端进程必须和自己是同一个用户，否则拒绝交接（状态里有所有连接和会话令牌）*/
+static int peer_is_self(int sock)
+{
+   struct ucred cred;
+   socklen_t len = sizeof(cred);
+
+   if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+      return 0;
+   if (cred.uid == geteuid())
+      return 1;
+   printf("handoff: refused peer pid:%d uid:%d\n", (int)cred.pid, (int)cred.uid);
+   return 0;
+}
+
+/*取下一个字段，返回1取到，0数据结束，-1格式错误*/
+static int next_field(const char **p, const char *end, int *tag, const char **data, uint32_t *n)
+{
+   if (*p == end)
+      return 0;
+   if (end - *p < 1 + (long)sizeof(*n))
+      return -1;
+   *tag = (unsigned char)**p;
+   memcpy(n, *p + 1, sizeof(*n));
+   if (*n > (size_t)(end - *p) - 1 - sizeof(*n))
+      return -1;
+   *data = *p + 1 + sizeof(*n);
+   *p = *data + *n;
+   return 1;
+}
+
+static int64_t get_int(const char *data, uint32_t n, int64_t def)
+{
+   int64_t v;
+   if (n != sizeof(v))
+      return def;
+   memcpy(&v, data, sizeof(v));
+   return v;
+}
+
+/*复制字符串字段，超长截断*/
+static void get_str(char *out, size_t size, const char *data, uint32_t n)
+{
+   if (n >= size)
+      n = size - 1;
+   memcpy(out, data, n);
+   out[n] = '\0';
+}
+
+//=============== 旧进程: 发送状态 ===============
+#define FIELD_SIZE(n) (1 + sizeof(uint32_t) + (n))
+
+static int send_fields(int sock, int kind, int fd, struct record *r)
+{
+   int ret = send_record(sock, kind, fd, r->data, r->len, NULL, 0);
+   r->len = 0;
+   return ret;
+}
+
+static int handoff_send(int sock)
+{
+   static struct record r; // 64KB，不放在栈上
+   unsigned long first, last;
+
+   r.len = 0;
+   put_field(&r, F_MAGIC, HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC) - 1);
+   put_int(&r, F_VERSION, HANDOFF_VERSION);
+   if (send_fields(sock, HANDOFF_HELLO, -1, &r) < 0)
+      return -1;
+
+   for (int i = 0; i < MAX_EVENTS; i++)
+   {
+      struct my_events *ev = &ep_events[i];
+      if (ev->m_status != 1)
+         continue;
+      if (ev->call_back == acceptconnect)
+      {
+         put_int(&r, F_SLOT, i);
+         if (send_fields(sock, HANDOFF_LISTEN, ev->m_fd, &r) < 0)
+            return -1;
+      }
+      else if (ev->call_back == recvdata || ev->call_back == senddata)
+      {
+         int pending = ev->call_back == senddata;
+         put_str(&r, F_ID, ev->m_id);
+         put_int(&r, F_PENDING, pending);
+         put_int(&r, F_CODEC, codec_get(ev->m_fd));
+         put_int(&r, F_TRUSTED, ev->m_trusted);
+         if (pending)
+            put_field(&r, F_BUF, ev->m_buf, ev->m_buf_len);
+         if (send_fields(sock, HANDOFF_CLIENT, ev->m_fd, &r) < 0)
+            return -1;
+      }
+   }
+
+   // 聊天记录和会话装满一条记录再发，几百万条消息不用每条三次系统调用
+   history_range(&first, &last);
+   for (unsigned long seq = first; seq <= last; seq++)
+   {
+      struct history_entry *e = history_get(seq);
+      size_t need = 2 * FIELD_SIZE(sizeof(int64_t)) + FIELD_SIZE(strlen(e->from)) + FIELD_SIZE(strlen(e->to)) + FIELD_SIZE(strlen(e->text));
+      if (r.len + need > sizeof(r.data) && send_fields(sock, HANDOFF_HISTORY, -1, &r) < 0)
+         return -1;
+      put_int(&r, F_SEQ, e->seq);
+      put_int(&r, F_TIME, e->time);
+      put_str(&r, F_FROM, e->from);
+      put_str(&r, F_TO, e->to);
+      put_str(&r, F_TEXT, e->text);
+   }
+   if (r.len > 0 && send_fields(sock, HANDOFF_HISTORY, -1, &r) < 0)
+      return -1;
+
+   for (int i = 0; i < SESSION_MAX; i++)
+   {
+      struct session *sess = session_get(i);
+      if (sess == NULL)
+         continue;
+      size_t need = FIELD_SIZE(strlen(sess->token)) + FIELD_SIZE(strlen(sess->name)) + FIELD_SIZE(sizeof(int64_t));
+      if (r.len + need > sizeof(r.data) && send_fields(sock, HANDOFF_SESSION, -1, &r) < 0)
+         return -1;
+      put_str(&r, F_TOKEN, sess->token);
+      put_str(&r, F_NAME, sess->name);
+      put_int(&r, F_EXPIRE, sess->expire);
+   }
+   if (r.len > 0 && send_fields(sock, HANDOFF_SESSION, -1, &r) < 0)
+      return -1;
+
+   return send_record(sock, HANDOFF_END, -1, NULL, 0, NULL, 0);
+}
+
+/*回调函数: 新进程连上来，交出全部状态*/
+static void handoff_accept(int listen_fd, int event, void *arg)
+{
+   struct timeval tv = {HANDOFF_ACK_TIMEOUT, 0};
+   char ack;
+   int sock = accept(listen_fd, NULL, NULL);
+   if (sock < 0)
+      return;
+   if (!peer_is_self(sock))
+   {
+      close(sock);
+      return;
+   }
+
+   printf("handoff: new server connected, sending state...\n");
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   if (handoff_send(sock) < 0 || read_full(sock, &ack, 1) < 0)
+   {
+      // 新进程没有确认，继续由本进程服务
+      printf("handoff: aborted, keep serving\n");
+      close(sock);
+      return;
+   }
+   close(sock);
+
+   printf("handoff: state transferred, exiting\n");
+   handed_off = 1;
+   server_running = 0;
+}
+
+/*在 HANDOFF_PATH 上监听，等待下一个版本来接手*/
+void handoff_listen()
+{
+   struct sockaddr_un addr;
+   int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (listen_fd < 0)
+   {
+      perror("handoff socket error");
+      return;
+   }
+   fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, HANDOFF_PATH, sizeof(addr.sun_path) - 1);
+   unlink(HANDOFF_PATH); // 上一个进程留下的路径
+   if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(HANDOFF_PATH, 0600) < 0 || listen(listen_fd, 1) < 0)
+   {
+      perror("handoff bind error");
+      close(listen_fd);
+      return;
+   }
+
+   eventset(&ep_events[HANDOFF_SLOT], listen_fd, handoff_accept, &ep_events[HANDOFF_SLOT]);
+   eventadd(ep_fd, EPOLLIN, &ep_events[HANDOFF_SLOT]);
+}
+
+/*退出时关闭交接监听；已经交接的话路径归新进程所有，不能删除*/
+void handoff_cleanup()
+{
+   if (ep_events[HANDOFF_SLOT].call_back != handoff_accept)
+      return;
+   close(ep_events[HANDOFF_SLOT].m_fd);
+   if (!handed_off)
+      unlink(HANDOFF_PATH);
+}
+
+//=============== 新进程: 接收状态 ===============
+/*找一个空闲的 ep_events 位置，保留位置除外*/
+static struct my_events *free_slot()
+{
+   for (int i = 0; i < UNIX_LISTEN_SLOT; i++)
+      if (ep_events[i].m_status == 0)
+         return &ep_events[i];
+   return NULL;
+}
+
+static int restore_client(int fd, const struct client_state *c)
+{
+   struct my_events *ev = free_slot();
+
+   if (ev == NULL || c->buf_len < 0 || c->buf_len >= (int)sizeof(ev->m_buf))
+      return -1;
+
+   if (c->pending)
+   {
+      eventset(ev, fd, senddata, ev);
+      memcpy(ev->m_buf, c->buf, c->buf_len);
+      ev->m_buf[c->buf_len] = '\0';
+      ev->m_buf_len = c->buf_len;
+   }
+   else
+      eventset(ev, fd, recvdata, ev);
+   strcpy(ev->m_id, c->id);
+   ev->m_trusted = c->trusted;
+   codec_set(fd, c->codec);
+
+   if (strcmp(ev->m_id, "NULL") != 0) // 已登录的用户放回在线链表
+   {
+      client_list_add(fd, ev->m_id);
+      online_count++;
+   }
+   eventadd(ep_fd, c->pending ? EPOLLOUT : EPOLLIN, ev);
+   return 0;
+}
+
+static void client_defaults(struct client_state *c)
+{
+   memset(c, 0, sizeof(*c));
+   strcpy(c->id, "NULL");
+   c->codec = CODEC_NONE;
+}
+
+static int parse_client(const char *data, int len, struct client_state *c)
+{
+   const char *p = data, *end = data + len, *v;
+   uint32_t n;
+   int tag, ret;
+
+   client_defaults(c);
+   while ((ret = next_field(&p, end, &tag, &v, &n)) > 0)
+   {
+      switch (tag)
+      {
+      case F_ID:      get_str(c->id, sizeof(c->id), v, n); break;
+      case F_PENDING: c->pending = get_int(v, n, 0); break;
+      case F_CODEC:   c->codec = get_int(v, n, CODEC_NONE); break;
+      case F_TRUSTED: c->trusted = get_int(v, n, 0); break;
+      case F_BUF:     c->buf = v; c->buf_len = n; break;
+      }
+   }
+   return ret;
+}
+
+/*版本1: 按数据长度认出是哪个版本的结构体*/
+static int parse_client_legacy(const char *data, int len, struct client_state *c)
+{
+   client_defaults(c);
+   for (size_t i = 0; i < sizeof(legacy_clients) / sizeof(legacy_clients[0]); i++)
+   {
+      const struct legacy_layout *l = &legacy_clients[i];
+      int buf_len;
+      if (len < l->size)
+         continue;
+      memcpy(&buf_len, data + l->size - sizeof(int), sizeof(int));
+      if (buf_len != len - l->size)
+         continue;
+      get_str(c->id, sizeof(c->id), data, 32);
+      memcpy(&c->pending, data + 32, sizeof(int));
+      if (l->codec_off >= 0)
+         memcpy(&c->codec, data + l->codec_off, sizeof(int));
+      if (l->trusted_off >= 0)
+         memcpy(&c->trusted, data + l->trusted_off, sizeof(int));
+      c->buf = data + l->size;
+      c->buf_len = buf_len;
+      return 0;
+   }
+   return -1;
+}
+
+/*一条 HISTORY 记录里可以有多条消息，每条从 F_SEQ 开始，返回恢复的条数*/
+static int restore_history(const char *data, int len)
+{
+   static char text[BUFSIZ];
+   const char *p = data, *end = data + len, *v;
+   char from[32] = "", to[32] = "";
+   unsigned long seq = 0;
+   time_t when = 0;
+   uint32_t n;
+   int tag, ret, count = 0;
+
+   text[0] = '\0';
+   while ((ret = next_field(&p, end, &tag, &v, &n)) > 0)
+   {
+      if (tag == F_SEQ && seq != 0) // 上一条结束
+      {
+         history_restore(seq, when, from, to, text);
+         count++;
+         from[0] = to[0] = text[0] = '\0';
+         when = 0;
+      }
+      switch (tag)
+      {
+      case F_SEQ:  seq = get_int(v, n, 0); break;
+      case F_TIME: when = get_int(v, n, 0); break;
+      case F_FROM: get_str(from, sizeof(from), v, n); break;
+      case F_TO:   get_str(to, sizeof(to), v, n); break;
+      case F_TEXT: get_str(text, sizeof(text), v, n); break;
+      }
+   }
+   if (ret < 0)
+      return -1;
+   if (seq != 0)
+   {
+      history_restore(seq, when, from, to, text);
+      count++;
+   }
+   return count;
+}
+
+/*版本1: 带 to 的结构体，或者最早没有 to 的（text_len 紧跟在 from 后面）*/
+static int restore_history_legacy(char *data, int len)
+{
+   struct legacy_history r;
+   size_t to_off = offsetof(struct legacy_history, to);
+   int text_len;
+
+   memset(&r, 0, sizeof(r));
+   memcpy(&text_len, data + offsetof(struct legacy_history, text_len), sizeof(int));
+   if (len >= (int)sizeof(r) && text_len == len - (int)sizeof(r))
+      memcpy(&r, data, sizeof(r));
+   else
+   {
+      if (len < LEGACY_HISTORY_NO_TO)
+         return -1;
+      memcpy(&text_len, data + to_off, sizeof(int));
+      if (text_len != len - LEGACY_HISTORY_NO_TO)
+         return -1;
+      memcpy(&r, data, to_off);
+      r.text_len = text_len;
+   }
+   r.from[sizeof(r.from) - 1] = '\0';
+   r.to[sizeof(r.to) - 1] = '\0';
+   data[len] = '\0';
+   history_restore(r.seq, r.time, r.from, r.to, data + len - r.text_len);
+   return 1;
+}
+
+/*一条 SESSION 记录里可以有多个会话，每个从 F_TOKEN 开始*/
+static int restore_sessions(const char *data, int len)
+{
+   const char *p = data, *end = data + len, *v;
+   struct session sess;
+   uint32_t n;
+   int tag, ret;
+
+   memset(&sess, 0, sizeof(sess));
+   while ((ret = next_field(&p, end, &tag, &v, &n)) > 0)
+   {
+      if (tag == F_TOKEN && sess.token[0] != '\0')
+      {
+         session_restore(&sess);
+         memset(&sess, 0, sizeof(sess));
+      }
+      switch (tag)
+      {
+      case F_TOKEN:  get_str(sess.token, sizeof(sess.token), v, n); break;
+      case F_NAME:   get_str(sess.name, sizeof(sess.name), v, n); break;
+      case F_EXPIRE: sess.expire = get_int(v, n, 0); break;
+      }
+   }
+   if (ret < 0)
+      return -1;
+   if (sess.token[0] != '\0')
+      session_restore(&sess);
+   return 0;
+}
+
+static int restore_session_legacy(const char *data, int len)
+{
+   struct session sess;
+   if (len != sizeof(sess))
+      return -1;
+   memcpy(&sess, data, sizeof(sess));
+   sess.token[sizeof(sess.token) - 1] = '\0';
+   sess.name[sizeof(sess.name) - 1] = '\0';
+   session_restore(&sess);
+   return 0;
+}
+
+/*监听socket的位置；版本1没有数据时是 TCP 监听，或者直接是一个 int*/
+static int listen_slot(const char *data, int len, int version)
+{
+   const char *p = data, *end = data + len, *v;
+   uint32_t n;
+   int tag, slot = MAX_EVENTS - 1;
+
+   if (version < 2)
+   {
+      if (len == sizeof(slot))
+         memcpy(&slot, data, sizeof(slot));
+      return slot;
+   }
+   while (next_field(&p, end, &tag, &v, &n) > 0)
+      if (tag == F_SLOT)
+         slot = get_int(v, n, slot);
+   return slot;
+}
+
+/*连接旧进程并接手它的全部状态，成功返回0*/
+int handoff_takeover()
+{
+   static char buf[HANDOFF_RECORD_MAX + 1]; // 多一个字节给正文的'\0'
+   struct sockaddr_un addr;
+   struct handoff_header h;
+   struct client_state c;
+   int fd;
+   int clients = 0, messages = 0;
+   int version = 1; // 第一条不是 HELLO 就是旧版本
+
+   int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, HANDOFF_PATH, sizeof(addr.sun_path) - 1);
+   if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+   {
+      perror("handoff connect error");
+      return -1;
+   }
+   if (!peer_is_self(sock)) // 不接手别的用户伪造的状态
+   {
+      close(sock);
+      return -1;
+   }
+
+   while (recv_record(sock, &h, &fd, buf, sizeof(buf) - 1) == 0)
+   {
+      if (version < 2 && h.kind == HANDOFF_SESSION && h.len == 0)
+         h.kind = HANDOFF_END; // 最早的版本没有会话，结束记录的编号是4
+      switch (h.kind)
+      {
+      case HANDOFF_HELLO:
+      {
+         const char *p = buf, *end = buf + h.len, *v;
+         uint32_t n;
+         int tag, magic = 0;
+         while (next_field(&p, end, &tag, &v, &n) > 0)
+         {
+            if (tag == F_MAGIC)
+               magic = n == sizeof(HANDOFF_MAGIC) - 1 && memcmp(v, HANDOFF_MAGIC, n) == 0;
+            else if (tag == F_VERSION)
+               version = get_int(v, n, 0);
+         }
+         if (!magic || version < 2)
+            goto fail;
+         printf("handoff: state stream version %d\n", version);
+         break;
+      }
+      case HANDOFF_LISTEN:
+      {
+         int slot = listen_slot(buf, h.len, version);
+         if (fd < 0 || (slot != MAX_EVENTS - 1 && slot != UNIX_LISTEN_SLOT))
+            goto fail;
+         eventset(&ep_events[slot], fd, acceptconnect, &ep_events[slot]);
+         eventadd(ep_fd, EPOLLIN, &ep_events[slot]);
+         break;
+      }
+      case HANDOFF_CLIENT:
+         if (fd < 0)
+            goto fail;
+         if ((version < 2 ? parse_client_legacy(buf, h.len, &c) : parse_client(buf, h.len, &c)) < 0 || restore_client(fd, &c) < 0)
+            goto fail;
+         clients++;
+         break;
+      case HANDOFF_HISTORY:
+      {
+         int n = version < 2 ? restore_history_legacy(buf, h.len) : restore_history(buf, h.len);
+         if (n < 0)
+            goto fail;
+         messages += n;
+         break;
+      }
+      case HANDOFF_SESSION:
+         if ((version < 2 ? restore_session_legacy(buf, h.len) : restore_sessions(buf, h.len)) < 0)
+            goto fail;
+         break;
+      case HANDOFF_END:
+         if (write_full(sock, "", 1) < 0) // 确认后旧进程才会退出
+            goto fail;
+         close(sock);
+         printf("handoff: took over %d clients, %d messages\n", clients, messages);
+         return 0;
+      default:
+         if (version < 2)
+            goto fail;
+         break; // 新版本增加的记录类型，跳过
+      }
+   }
+
+fail:
+   printf("handoff: broken state stream\n");
+   close(sock);
+   return -1;
+}
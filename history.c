@@ -0,0 +1,140 @@
+/*聊天记录：最近 HISTORY_MAX 条消息的环形缓冲区
+  广播、私聊和系统通知共用一个递增的编号，断线重连时按编号补发
+  只有公开的聊天消息进索引，新消息写入时建立索引，最旧的消息被覆盖时同时从索引中删除*/
+#include "chat.h"
+
+static struct history_entry *ring; // 编号为 seq 的消息放在 ring[seq % HISTORY_MAX]
+static unsigned long first_seq = 1;   // 最旧的保留消息编号
+static unsigned long last_seq = 0;    // 最新的消息编号，0表示还没有消息
+
+void history_init()
+{
+   // calloc 大块内存时按需分页，未使用的部分不占物理内存
+   ring = calloc(HISTORY_MAX, sizeof(*ring));
+   if (ring == NULL)
+   {
+      perror("history calloc error");
+      exit(-1);
+   }
+}
+
+/*公开的聊天消息才能被搜索到，私聊和系统通知不进索引*/
+static int history_indexed(const struct history_entry *e)
+{
+   return e->from[0] != '\0' && e->to[0] == '\0';
+}
+
+static void history_store(unsigned long seq, time_t when, const char *from, const char *to, const char *text)
+{
+   struct history_entry *e = &ring[seq % HISTORY_MAX];
+
+   if (seq - first_seq >= HISTORY_MAX) // 缓冲区已满，覆盖最旧的一条
+   {
+      if (history_indexed(e))
+         search_remove(e->seq, e->text);
+      free(e->text);
+      first_seq++;
+   }
+
+   e->seq = seq;
+   e->time = when;
+   strncpy(e->from, from, sizeof(e->from) - 1);
+   e->from[sizeof(e->from) - 1] = '\0';
+   strncpy(e->to, to, sizeof(e->to) - 1);
+   e->to[sizeof(e->to) - 1] = '\0';
+   size_t len = strlen(text) + 1;
+   e->text = malloc(len); // 不用 strdup：libc 内部的分配 chat_bench 统计不到
+   memcpy(e->text, text, len);
+   // 正文中间的换行换成空格：客户端按行解析，不能让用户伪造 "#session" 之类的控制行
+   for (char *p = e->text; *p != '\0'; p++)
+      if (*p == '\n' || *p == '\r')
+         *p = ' ';
+   last_seq = seq;
+
+   if (history_indexed(e))
+      search_add(seq, e->text);
+}
+
+/*保存一条消息，返回分配的编号
+  from 为空表示系统通知，to 不为空表示私聊*/
+unsigned long history_add(const char *from, const char *to, const char *text)
+{
+   history_store(last_seq + 1, time(NULL), from, to, text);
+   return last_seq;
+}
+
+/*热重启时按原编号恢复一条消息，编号必须连续递增*/
+void history_restore(unsigned long seq, time_t when, const char *from, const char *to, const char *text)
+{
+   if (last_seq == 0)
+      first_seq = seq;
+   history_store(seq, when, from, to, text);
+}
+
+/*当前保留的编号范围，没有消息时 *first > *last*/
+void history_range(unsigned long *first, unsigned long *last)
+{
+   *first = first_seq;
+   *last = last_seq;
+}
+
+/*按编号取消息，已过期或不存在返回NULL*/
+struct history_entry *history_get(unsigned long seq)
+{
+   if (seq < first_seq || seq > last_seq)
+      return NULL;
+   return &ring[seq % HISTORY_MAX];
+}
+
+/*viewer 能否看到这条消息：私聊只有双方能看到*/
+int history_visible(const struct history_entry *e, const char *viewer)
+{
+   return e->to[0] == '\0' || strcmp(e->from, viewer) == 0 || strcmp(e->to, viewer) == 0;
+}
+
+/*按 viewer 看到的样子把消息格式化成 "#编号 内容\n"，返回长度*/
+static int format_line(const struct history_entry *e, const char *viewer, char *buf, size_t size, int text_len)
+{
+   if (e->from[0] == '\0') // 系统通知，保存的就是完整的一行
+      return snprintf(buf, size, "#%lu %.*s\n", e->seq, text_len, e->text);
+   if (e->to[0] == '\0')
+      return snprintf(buf, size, "#%lu %s: %.*s\n", e->seq, e->from, text_len, e->text);
+   if (strcmp(viewer, e->to) == 0) // 给接收者的消息
+      return snprintf(buf, size, "#%lu \033[35m%s 悄悄地对你说: %.*s\033[0m\n", e->seq, e->from, text_len, e->text);
+   // 给发送者的确认消息
+   return snprintf(buf, size, "#%lu \033[35m你悄悄地对 %s 说: %.*s\033[0m\n", e->seq, e->to, text_len, e->text);
+}
+
+int history_format(const struct history_entry *e, const char *viewer, char *buf, size_t size)
+{
+   int text_len = strlen(e->text);
+   int n = format_line(e, viewer, buf, size, text_len);
+   if (n < 0)
+      return 0;
+   if ((size_t)n < size)
+      return n;
+
+   // 放不下时截短正文，行尾的颜色重置和换行必须保留，否则客户端会把下一行拼上来
+   text_len -= n - ((int)size - 1);
+   if (text_len < 0)
+      text_len = 0;
+   while (text_len > 0 && ((unsigned char)e->text[text_len] & 0xC0) == 0x80) // 不截断半个 UTF-8 字符
+      text_len--;
+   n = format_line(e, viewer, buf, size, text_len);
+   if (n < 0)
+      return 0;
+   return (size_t)n < size ? n : (int)size - 1;
+}
+
+void history_cleanup()
+{
+   if (ring == NULL)
+      return;
+   for (unsigned long seq = first_seq; seq <= last_seq; seq++)
+      free(ring[seq % HISTORY_MAX].text);
+   free(ring);
+   ring = NULL;
+   first_seq = 1;
+   last_seq = 0;
+   search_cleanup();
+}
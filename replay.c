@@ -0,0 +1,315 @@
+/*回放 ./server --capture 录下的流量，对比性能改动前后的表现
+  每个录制的连接用一对 socketpair 模拟：一端交给服务器逻辑（和 acceptconnect 之后一样），
+  另一端写入录下的数据；每写入一批就把服务器的事件处理完，保证 recvdata 读到的边界和录制时一致
+  结果: 吞吐、每批数据的处理延迟、服务器逻辑的系统调用次数
+  用法: make replay TRACE=文件 [SPEED=倍速] 或 ./chat_replay 文件 [倍速]
+        倍速 1 按录制时的间隔回放，10 快十倍，0（默认）不等待
+  需要在服务器的工作目录下运行（登录要读 user.txt）*/
+#include "chat.h"
+#include <sys/resource.h>
+
+#define REPLAY_SNDBUF (4 << 20) // 放大缓冲区，广播时不丢消息
+#define REPLAY_DRAIN_BATCH 256
+
+//=============== 系统调用计数（链接时 --wrap），只统计服务器逻辑里的调用 ===============
+enum
+{
+   SC_RECV,
+   SC_SEND,
+   SC_SENDMSG,
+   SC_EPOLL_WAIT,
+   SC_EPOLL_CTL,
+   SC_CLOSE,
+   SC_COUNT
+};
+static const char *sc_names[SC_COUNT] = {"recv", "send", "sendmsg", "epoll_wait", "epoll_ctl", "close"};
+static unsigned long sc_count[SC_COUNT];
+static int counting = 0;
+
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_sendmsg(int fd, const struct msghdr *msg, int flags);
+int __real_epoll_wait(int ep_fd, struct epoll_event *events, int max, int timeout);
+int __real_epoll_ctl(int ep_fd, int op, int fd, struct epoll_event *event);
+int __real_close(int fd);
+
+ssize_t __wrap_recv(int fd, void *buf, size_t len, int flags)
+{
+   sc_count[SC_RECV] += counting;
+   return __real_recv(fd, buf, len, flags);
+}
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags)
+{
+   sc_count[SC_SEND] += counting;
+   return __real_send(fd, buf, len, flags);
+}
+ssize_t __wrap_sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+   sc_count[SC_SENDMSG] += counting;
+   return __real_sendmsg(fd, msg, flags);
+}
+int __wrap_epoll_wait(int ep_fd, struct epoll_event *events, int max, int timeout)
+{
+   sc_count[SC_EPOLL_WAIT] += counting;
+   return __real_epoll_wait(ep_fd, events, max, timeout);
+}
+int __wrap_epoll_ctl(int ep_fd, int op, int fd, struct epoll_event *event)
+{
+   sc_count[SC_EPOLL_CTL] += counting;
+   return __real_epoll_ctl(ep_fd, op, fd, event);
+}
+int __wrap_close(int fd)
+{
+   sc_count[SC_CLOSE] += counting;
+   return __real_close(fd);
+}
+
+//=============== 假的客户端 ===============
+static int peer_fd[CODEC_MAX_FD]; // 录制时的 fd -> 模拟客户端那一端，0 表示没有
+static int peer_ep;               // 模拟客户端的 epoll，用来读空服务器发来的数据
+static unsigned long conns, bytes_in, bytes_out;
+static FILE *report; // 结果输出（stdout 被重定向到 /dev/null，屏蔽服务器日志）
+
+static uint64_t now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*处理完服务器上所有就绪事件（recvdata 之后的 senddata 也在这里）*/
+static void server_run()
+{
+   counting = 1;
+   while (eventdispatch(ep_fd, 0) > 0)
+      ;
+   counting = 0;
+}
+
+/*读空服务器发给所有模拟客户端的数据*/
+static void peers_drain()
+{
+   struct epoll_event evs[REPLAY_DRAIN_BATCH];
+   char buf[65536];
+   int n;
+
+   do
+   {
+      n = epoll_wait(peer_ep, evs, REPLAY_DRAIN_BATCH, 0);
+      for (int i = 0; i < n; i++)
+      {
+         ssize_t len;
+         while ((len = read(evs[i].data.fd, buf, sizeof(buf))) > 0)
+            bytes_out += len;
+         if (len == 0) // 服务器关掉了这个连接（被顶掉），不再关注
+            epoll_ctl(peer_ep, EPOLL_CTL_DEL, evs[i].data.fd, NULL);
+      }
+   } while (n == REPLAY_DRAIN_BATCH);
+}
+
+static void peer_close(int conn)
+{
+   if (peer_fd[conn] == 0)
+      return;
+   close(peer_fd[conn]); // 服务器那一端读到 EOF，和录制时一样走断开流程
+   peer_fd[conn] = 0;
+}
+
+static int peer_open(int conn, int trusted)
+{
+   int fds[2];
+   int sz = REPLAY_SNDBUF;
+   struct epoll_event ev;
+
+   peer_close(conn); // 录制时服务器自己关掉的连接（被顶掉的旧连接）没有 CLOSE 记录
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+   {
+      perror("socketpair");
+      return -1;
+   }
+   setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+   setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+   fcntl(fds[1], F_SETFL, O_NONBLOCK);
+   ev.events = EPOLLIN;
+   ev.data.fd = fds[1];
+   epoll_ctl(peer_ep, EPOLL_CTL_ADD, fds[1], &ev);
+   peer_fd[conn] = fds[1];
+   conns++;
+
+   counting = 1;
+   int slot = addconnection(fds[0], trusted);
+   counting = 0;
+   return slot < 0 ? -1 : 0;
+}
+
+static void peer_write(int conn, const char *buf, size_t len)
+{
+   while (len > 0)
+   {
+      ssize_t n = write(peer_fd[conn], buf, len);
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         if (errno != EAGAIN)
+            return;
+         server_run(); // 缓冲区满，先让服务器读走
+         peers_drain();
+         continue;
+      }
+      buf += n;
+      len -= n;
+   }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+static int raise_fd_limit()
+{
+   struct rlimit rl;
+   getrlimit(RLIMIT_NOFILE, &rl);
+   rl.rlim_cur = rl.rlim_max;
+   return setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+int main(int argc, char *argv[])
+{
+   static char buf[BUFSIZ];
+   char magic[sizeof(CAPTURE_MAGIC) - 1];
+   double speed = 0;
+   struct capture_record rec;
+   uint64_t *lat = NULL; // 每批数据的处理时间（纳秒）
+   size_t nlat = 0, lat_cap = 0;
+   uint64_t trace_us = 0, lag_ns = 0;
+   int ret;
+
+   if (argc < 2 || argc > 3)
+   {
+      fprintf(stderr, "usage: %s trace_file [speed]\n", argv[0]);
+      exit(1);
+   }
+   if (argc == 3)
+      speed = atof(argv[2]);
+
+   FILE *fp = fopen(argv[1], "rb");
+   if (fp == NULL)
+   {
+      perror("open trace");
+      exit(1);
+   }
+   if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0)
+   {
+      fprintf(stderr, "%s: not a capture file\n", argv[1]);
+      exit(1);
+   }
+
+   // 服务器函数里的 printf 会刷屏，结果单独输出
+   report = fdopen(dup(STDOUT_FILENO), "w");
+   if (report == NULL || freopen("/dev/null", "w", stdout) == NULL)
+   {
+      perror("redirect stdout");
+      exit(1);
+   }
+   signal(SIGPIPE, SIG_IGN);
+   raise_fd_limit();
+   ep_fd = epoll_create(MAX_EVENTS);
+   peer_ep = epoll_create(MAX_EVENTS);
+   if (ep_fd < 0 || peer_ep < 0)
+   {
+      perror("epoll_create error");
+      exit(1);
+   }
+   init_list();
+   history_init();
+
+   uint64_t start = now_ns();
+   while ((ret = capture_next(fp, &rec, buf, sizeof(buf))) > 0)
+   {
+      if (rec.conn < 0 || rec.conn >= CODEC_MAX_FD)
+      {
+         ret = -1;
+         break;
+      }
+
+      // 按倍速等到录制时的时间点
+      trace_us += rec.delta_us;
+      if (speed > 0)
+      {
+         uint64_t due = start + (uint64_t)(trace_us * 1000 / speed);
+         uint64_t now = now_ns();
+         if (now < due)
+         {
+            struct timespec ts = {(due - now) / 1000000000, (due - now) % 1000000000};
+            nanosleep(&ts, NULL);
+         }
+         else if (now - due > lag_ns)
+            lag_ns = now - due;
+      }
+
+      switch (rec.type)
+      {
+      case CAPTURE_ACCEPT:
+         if (peer_open(rec.conn, rec.trusted) < 0)
+            continue;
+         server_run();
+         break;
+      case CAPTURE_DATA:
+      {
+         // 热重启接手的连接没有 ACCEPT 记录，第一次出现时补上
+         if (peer_fd[rec.conn] == 0 && peer_open(rec.conn, 0) < 0)
+            continue;
+         peer_write(rec.conn, buf, rec.len);
+         uint64_t t0 = now_ns();
+         server_run();
+         if (nlat == lat_cap)
+         {
+            lat_cap = lat_cap ? lat_cap * 2 : 4096;
+            lat = realloc(lat, lat_cap * sizeof(*lat));
+         }
+         lat[nlat++] = now_ns() - t0;
+         bytes_in += rec.len;
+         break;
+      }
+      case CAPTURE_CLOSE:
+         peer_close(rec.conn);
+         server_run();
+         break;
+      }
+      peers_drain();
+   }
+   double wall = (now_ns() - start) / 1e9;
+   fclose(fp);
+   if (ret < 0)
+      fprintf(report, "warning: trace is truncated or corrupt, stopped early\n");
+
+   unsigned long total = 0;
+   for (int i = 0; i < SC_COUNT; i++)
+      total += sc_count[i];
+   double per = nlat ? (double)nlat : 1;
+
+   fprintf(report, "trace %s: %lu connections, %zu batches, %lu bytes in, %lu bytes out, %.3f s recorded\n",
+           argv[1], conns, nlat, bytes_in, bytes_out, trace_us / 1e6);
+   if (speed > 0)
+      fprintf(report, "speed x%g, max lag behind schedule %.3f ms\n", speed, lag_ns / 1e6);
+   fprintf(report, "wall %.3f s, %.0f batches/s, %.2f MB/s in, %.2f MB/s out\n",
+           wall, nlat / wall, bytes_in / wall / 1e6, bytes_out / wall / 1e6);
+   if (nlat > 0)
+   {
+      qsort(lat, nlat, sizeof(*lat), cmp_u64);
+      fprintf(report, "latency per batch (us): p50 %.1f  p99 %.1f  max %.1f\n",
+              lat[nlat / 2] / 1e3, lat[nlat * 99 / 100] / 1e3, lat[nlat - 1] / 1e3);
+   }
+   fprintf(report, "syscalls: %lu total, %.2f/batch\n", total, total / per);
+   for (int i = 0; i < SC_COUNT; i++)
+      fprintf(report, "  %-12s %10lu %10.2f/batch\n", sc_names[i], sc_count[i], sc_count[i] / per);
+   fclose(report);
+
+   free(lat);
+   cleanup_client_list();
+   history_cleanup();
+   return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,472 @@
+/*聊天记录的倒排索引
+  词 -> 包含该词的消息编号列表(posting)，编号递增，按差值用变长整数(varint)压缩存储
+  消息只会从最旧的一端过期，所以删除永远发生在列表头部
+  差值只能从前往后解码，所以每 SEARCH_BLOCK 个编号记一个跳转点，
+  查询时从最新的一端按块往回走，找够 SEARCH_RESULTS_MAX 条就停，不用解码整个列表*/
+#include "chat.h"
+
+#define SEARCH_BLOCK 128 // 每块的编号数
+
+struct skip
+{
+   unsigned int pos;          // data 中一个差值的位置
+   unsigned long seq;         // 加上这个差值之前的编号，即上一块的最后一个编号
+};
+
+struct posting
+{
+   char token[SEARCH_TOKEN_MAX];
+   unsigned long first;       // 列表中第一个（最旧）消息编号
+   unsigned long last;        // 列表中最后一个（最新）消息编号
+   unsigned int count;        // 编号个数
+   unsigned int head;         // data[head, len) 依次是 first 之后每个编号与前一个的差值
+   unsigned int len;
+   unsigned int cap;
+   unsigned char *data;
+   struct skip *skips;        // skips[skip_head, skip_len) 是仍有效的跳转点，pos 递增
+   unsigned int skip_head;
+   unsigned int skip_len;
+   unsigned int skip_cap;
+   unsigned int since_skip;   // 上一个跳转点之后追加的编号数
+   struct posting *next;      // 哈希冲突链
+};
+
+/*从最新的一端往回遍历一个列表，每次解码一块*/
+struct cursor
+{
+   struct posting *post;
+   int block;                 // 当前块：0 从 first 开始，k>0 从 skips[skip_head + k - 1] 开始
+   int n;                     // 当前块解码出的编号数
+   int i;                     // 下一个要返回的下标（递减）
+   unsigned long vals[SEARCH_BLOCK + 1];
+};
+
+static struct posting **table;
+static unsigned int table_size;  // 桶数，2的幂
+static unsigned int token_count;
+
+//=============== 分词 ===============
+/*由首字节得到 UTF-8 字符的字节数，不读后面的字节*/
+static int utf8_len(unsigned char lead)
+{
+   return lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+/*s 必须已确认有 n 个字节（首字节和 n-1 个续字节）*/
+static unsigned int utf8_decode(const unsigned char *s, int n)
+{
+   if (n == 2) return ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+   if (n == 3) return ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+   return ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+}
+
+static int is_punct(unsigned int cp)
+{
+   return (cp >= 0x2000 && cp <= 0x206F)    // 通用标点 —— … “”
+       || (cp >= 0x3000 && cp <= 0x303F)    // 中文标点 、。《》
+       || (cp >= 0xFF01 && cp <= 0xFF0F)    // 全角 ！（），
+       || (cp >= 0xFF1A && cp <= 0xFF20);   // 全角 ：；？
+}
+
+/*从 *p 开始取下一个词，写入 token，返回0表示没有更多的词
+  ASCII 字母数字连续成词并转小写；其他每个 UTF-8 字符（汉字）单独成词，
+  所以中文查询按字求交集*/
+int search_next_token(const char **p, char *token)
+{
+   const unsigned char *s = (const unsigned char *)*p;
+   int n = 0;
+
+   while (*s)
+   {
+      if (*s == '\033') // 跳过 ANSI 颜色码 ESC [ ... 字母
+      {
+         s++;
+         if (*s == '[')
+            while (*++s && !((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z')))
+               ;
+         if (*s)
+            s++;
+         continue;
+      }
+      if (*s < 0x80)
+      {
+         if (!((*s >= '0' && *s <= '9') || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z')))
+         {
+            s++;
+            continue;
+         }
+         while ((*s >= '0' && *s <= '9') || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z'))
+         {
+            if (n < SEARCH_TOKEN_MAX - 1) // 超长的词截断
+               token[n++] = (*s >= 'A' && *s <= 'Z') ? *s + 32 : *s;
+            s++;
+         }
+         break;
+      }
+      if (*s < 0xC0) // 孤立的续字节，不是合法的 UTF-8
+      {
+         s++;
+         continue;
+      }
+
+      // 先数续字节，遇到 '\0' 就停，确认字符完整后才解码
+      int len = utf8_len(*s);
+      int i;
+      for (i = 1; i < len && (s[i] & 0xC0) == 0x80; i++)
+         ;
+      if (i < len) // 字符被截断
+      {
+         s += i;
+         continue;
+      }
+      unsigned int cp = utf8_decode(s, len);
+      if (!is_punct(cp))
+      {
+         memcpy(token, s, len);
+         n = len;
+      }
+      s += len;
+      if (n > 0)
+         break;
+   }
+   token[n] = '\0';
+   *p = (const char *)s;
+   return n > 0;
+}
+
+//=============== 哈希表 ===============
+static unsigned int hash_token(const char *token)
+{
+   unsigned int h = 2166136261u; // FNV-1a
+   while (*token)
+   {
+      h ^= (unsigned char)*token++;
+      h *= 16777619u;
+   }
+   return h;
+}
+
+static void table_grow()
+{
+   unsigned int new_size = table_size ? table_size * 2 : 1024;
+   struct posting **new_table = calloc(new_size, sizeof(*new_table));
+   for (unsigned int i = 0; i < table_size; i++)
+   {
+      struct posting *cur = table[i];
+      while (cur != NULL)
+      {
+         struct posting *next = cur->next;
+         unsigned int b = hash_token(cur->token) & (new_size - 1);
+         cur->next = new_table[b];
+         new_table[b] = cur;
+         cur = next;
+      }
+   }
+   free(table);
+   table = new_table;
+   table_size = new_size;
+}
+
+static struct posting **table_slot(const char *token)
+{
+   struct posting **pp = &table[hash_token(token) & (table_size - 1)];
+   while (*pp != NULL && strcmp((*pp)->token, token) != 0)
+      pp = &(*pp)->next;
+   return pp; // 找到时 *pp 为该词，否则指向链尾的 NULL
+}
+
+static struct posting *table_find(const char *token)
+{
+   if (table_size == 0)
+      return NULL;
+   return *table_slot(token);
+}
+
+//=============== 变长整数 ===============
+static void skip_append(struct posting *p, unsigned int pos, unsigned long seq)
+{
+   if (p->skip_len == p->skip_cap)
+   {
+      if (p->skip_head > 0)
+      {
+         memmove(p->skips, p->skips + p->skip_head, (p->skip_len - p->skip_head) * sizeof(*p->skips));
+         p->skip_len -= p->skip_head;
+         p->skip_head = 0;
+      }
+      if (p->skip_len == p->skip_cap)
+      {
+         p->skip_cap = p->skip_cap ? p->skip_cap * 2 : 4;
+         p->skips = realloc(p->skips, p->skip_cap * sizeof(*p->skips));
+      }
+   }
+   p->skips[p->skip_len].pos = pos;
+   p->skips[p->skip_len].seq = seq;
+   p->skip_len++;
+}
+
+/*追加一个编号的差值，调用时 p->last 还是上一个编号*/
+static void posting_append(struct posting *p, unsigned long delta)
+{
+   if (p->len + 10 > p->cap) // 一个 unsigned long 最多10个字节
+   {
+      if (p->head > 0) // 先把头部已删除的空间挪回来，跳转点跟着平移
+      {
+         memmove(p->data, p->data + p->head, p->len - p->head);
+         for (unsigned int i = p->skip_head; i < p->skip_len; i++)
+            p->skips[i].pos -= p->head;
+         p->len -= p->head;
+         p->head = 0;
+      }
+      if (p->len + 10 > p->cap)
+      {
+         p->cap = p->cap ? p->cap * 2 : 16;
+         p->data = realloc(p->data, p->cap);
+      }
+   }
+   if (++p->since_skip >= SEARCH_BLOCK)
+   {
+      skip_append(p, p->len, p->last);
+      p->since_skip = 0;
+   }
+   while (delta >= 0x80)
+   {
+      p->data[p->len++] = (delta & 0x7F) | 0x80;
+      delta >>= 7;
+   }
+   p->data[p->len++] = delta;
+}
+
+static unsigned long varint_read(const unsigned char *data, unsigned int *pos)
+{
+   unsigned long v = 0;
+   int shift = 0;
+   unsigned char b;
+   do
+   {
+      b = data[(*pos)++];
+      v |= (unsigned long)(b & 0x7F) << shift;
+      shift += 7;
+   } while (b & 0x80);
+   return v;
+}
+
+//=============== 索引维护 ===============
+void search_add(unsigned long seq, const char *text)
+{
+   char token[SEARCH_TOKEN_MAX];
+   const char *p = text;
+
+   while (search_next_token(&p, token))
+   {
+      if (token_count >= table_size)
+         table_grow();
+      struct posting **pp = table_slot(token);
+      struct posting *post = *pp;
+      if (post == NULL)
+      {
+         post = calloc(1, sizeof(*post));
+         strcpy(post->token, token);
+         post->first = post->last = seq;
+         post->count = 1;
+         *pp = post;
+         token_count++;
+         continue;
+      }
+      if (post->last == seq) // 同一条消息里重复出现的词
+         continue;
+      posting_append(post, seq - post->last);
+      post->last = seq;
+      post->count++;
+   }
+}
+
+void search_remove(unsigned long seq, const char *text)
+{
+   char token[SEARCH_TOKEN_MAX];
+   const char *p = text;
+
+   while (search_next_token(&p, token))
+   {
+      if (table_size == 0)
+         return;
+      struct posting **pp = table_slot(token);
+      struct posting *post = *pp;
+      if (post == NULL || post->first != seq) // 重复的词已经删过了
+         continue;
+      if (post->count == 1)
+      {
+         *pp = post->next;
+         free(post->data);
+         free(post->skips);
+         free(post);
+         token_count--;
+         continue;
+      }
+      post->first += varint_read(post->data, &post->head);
+      post->count--;
+      // 新的头部就是第0块的起点，落在它之前（含）的跳转点没用了
+      while (post->skip_head < post->skip_len && post->skips[post->skip_head].pos <= post->head)
+         post->skip_head++;
+   }
+}
+
+void search_cleanup()
+{
+   for (unsigned int i = 0; i < table_size; i++)
+   {
+      struct posting *cur = table[i];
+      while (cur != NULL)
+      {
+         struct posting *next = cur->next;
+         free(cur->data);
+         free(cur->skips);
+         free(cur);
+         cur = next;
+      }
+   }
+   free(table);
+   table = NULL;
+   table_size = 0;
+   token_count = 0;
+}
+
+//=============== 查询 ===============
+static int cursor_blocks(const struct posting *p)
+{
+   return p->skip_len - p->skip_head + 1;
+}
+
+/*解码第 k 块*/
+static void cursor_load(struct cursor *cur, int k)
+{
+   const struct posting *p = cur->post;
+   unsigned int pos, end;
+   unsigned long seq;
+
+   cur->n = 0;
+   if (k == 0)
+   {
+      pos = p->head;
+      seq = p->first;
+      cur->vals[cur->n++] = seq;
+   }
+   else
+   {
+      pos = p->skips[p->skip_head + k - 1].pos;
+      seq = p->skips[p->skip_head + k - 1].seq;
+   }
+   end = k + 1 < cursor_blocks(p) ? p->skips[p->skip_head + k].pos : p->len;
+   while (pos < end && cur->n <= SEARCH_BLOCK)
+   {
+      seq += varint_read(p->data, &pos);
+      cur->vals[cur->n++] = seq;
+   }
+   cur->block = k;
+   cur->i = cur->n - 1;
+}
+
+static void cursor_init(struct cursor *cur, struct posting *p)
+{
+   cur->post = p;
+   cur->block = cursor_blocks(p); // 还没有解码任何块
+   cur->n = 0;
+   cur->i = -1;
+}
+
+/*取下一个（更旧的）编号，列表走完返回0*/
+static int cursor_prev(struct cursor *cur, unsigned long *seq)
+{
+   while (cur->i < 0)
+   {
+      if (cur->block == 0)
+         return 0;
+      cursor_load(cur, cur->block - 1);
+   }
+   *seq = cur->vals[cur->i--];
+   return 1;
+}
+
+/*列表中是否有 target，多次调用时 target 必须递减*/
+static int cursor_find(struct cursor *cur, unsigned long target)
+{
+   const struct posting *p = cur->post;
+
+   if (cur->n == 0 || cur->vals[0] > target)
+   {
+      // 二分找包含 target 的块：第 k(k>0) 块的编号都大于 skips[k-1].seq
+      int lo = 0, hi = cur->block - 1;
+      if (hi < 0)
+         return 0;
+      while (lo < hi)
+      {
+         int mid = (lo + hi + 1) / 2;
+         if (p->skips[p->skip_head + mid - 1].seq < target)
+            lo = mid;
+         else
+            hi = mid - 1;
+      }
+      cursor_load(cur, lo);
+   }
+   while (cur->i >= 0 && cur->vals[cur->i] > target)
+      cur->i--;
+   return cur->i >= 0 && cur->vals[cur->i] == target;
+}
+
+/*查找同时包含 query 中所有词的消息，最新的 max 条编号按从新到旧写入 out，返回写入的条数
+  从最短的列表的最新一端往回走，找够 max 条或检查了 SEARCH_SCAN_MAX 个候选就停，
+  *total 为匹配总数，提前停下时不知道总数，为-1*/
+int search_query(const char *query, unsigned long *out, int max, int *total)
+{
+   static struct cursor cursors[SEARCH_TERMS_MAX]; // 每个约1KB，不放在栈上
+   struct posting *terms[SEARCH_TERMS_MAX];
+   char token[SEARCH_TOKEN_MAX];
+   const char *p = query;
+   int nterms = 0;
+
+   *total = 0;
+   while (nterms < SEARCH_TERMS_MAX && search_next_token(&p, token))
+   {
+      struct posting *post = table_find(token);
+      if (post == NULL)
+         return 0; // 有一个词不存在，交集为空
+      int dup = 0;
+      for (int i = 0; i < nterms; i++)
+         dup |= terms[i] == post;
+      if (!dup)
+         terms[nterms++] = post;
+   }
+   if (nterms == 0)
+      return 0;
+
+   // 从最短的列表开始求交集
+   for (int i = 1; i < nterms; i++)
+      for (int j = i; j > 0 && terms[j]->count < terms[j - 1]->count; j--)
+      {
+         struct posting *t = terms[j];
+         terms[j] = terms[j - 1];
+         terms[j - 1] = t;
+      }
+   for (int t = 0; t < nterms; t++)
+      cursor_init(&cursors[t], terms[t]);
+
+   int n = 0;
+   unsigned long seq;
+   unsigned int scanned = 0;
+   while (n < max && scanned < SEARCH_SCAN_MAX && cursor_prev(&cursors[0], &seq))
+   {
+      int t;
+      scanned++;
+      for (t = 1; t < nterms && cursor_find(&cursors[t], seq); t++)
+         ;
+      if (t == nterms)
+         out[n++] = seq;
+   }
+
+   if (nterms == 1)
+      *total = terms[0]->count; // 单个词的总数就是列表长度
+   else if (!cursor_prev(&cursors[0], &seq))
+      *total = n; // 整个列表都走完了
+   else
+      *total = -1;
+   return n;
+}
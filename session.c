@@ -0,0 +1,101 @@
+/*会话令牌：登录成功后发给客户端，断线后 SESSION_TTL 秒内可以凭令牌和最后收到的编号续上
+  客户端发送 "/resume 令牌 编号" 代替用户名密码，服务器只补发中间缺失的消息*/
+#include "chat.h"
+#include <sys/random.h>
+
+static struct session sessions[SESSION_MAX];
+
+static int session_valid(const struct session *s, time_t now)
+{
+   return s->token[0] != '\0' && (s->expire == 0 || s->expire > now);
+}
+
+static void make_token(char *token)
+{
+   unsigned char raw[SESSION_TOKEN_LEN / 2];
+   if (getrandom(raw, sizeof(raw), 0) != sizeof(raw))
+      for (size_t i = 0; i < sizeof(raw); i++)
+         raw[i] = rand();
+   for (size_t i = 0; i < sizeof(raw); i++)
+      sprintf(token + i * 2, "%02x", raw[i]);
+}
+
+/*用户登录成功，签发新令牌（同名用户的旧令牌作废），返回令牌*/
+const char *session_open(const char *name)
+{
+   time_t now = time(NULL);
+   struct session *slot = NULL;
+
+   for (int i = 0; i < SESSION_MAX; i++)
+   {
+      if (sessions[i].token[0] != '\0' && strcmp(sessions[i].name, name) == 0)
+      {
+         slot = &sessions[i];
+         break;
+      }
+      if (slot == NULL && !session_valid(&sessions[i], now))
+         slot = &sessions[i];
+   }
+   if (slot == NULL) // 表满了，顶掉最早过期的
+   {
+      slot = &sessions[0];
+      for (int i = 1; i < SESSION_MAX; i++)
+         if (sessions[i].expire != 0 && (slot->expire == 0 || sessions[i].expire < slot->expire))
+            slot = &sessions[i];
+   }
+
+   make_token(slot->token);
+   strncpy(slot->name, name, sizeof(slot->name) - 1);
+   slot->name[sizeof(slot->name) - 1] = '\0';
+   slot->expire = 0;
+   return slot->token;
+}
+
+/*凭令牌恢复会话，返回用户名，令牌无效或已过期返回NULL*/
+const char *session_resume(const char *token)
+{
+   time_t now = time(NULL);
+   for (int i = 0; i < SESSION_MAX; i++)
+   {
+      if (session_valid(&sessions[i], now) && strcmp(sessions[i].token, token) == 0)
+      {
+         sessions[i].expire = 0;
+         return sessions[i].name;
+      }
+   }
+   return NULL;
+}
+
+/*用户断线，令牌保留 SESSION_TTL 秒*/
+void session_close(const char *name)
+{
+   for (int i = 0; i < SESSION_MAX; i++)
+   {
+      if (sessions[i].token[0] != '\0' && sessions[i].expire == 0 && strcmp(sessions[i].name, name) == 0)
+      {
+         sessions[i].expire = time(NULL) + SESSION_TTL;
+         return;
+      }
+   }
+}
+
+/*取第 i 个有效会话，热重启时遍历用，无效位置返回NULL*/
+struct session *session_get(int i)
+{
+   if (i < 0 || i >= SESSION_MAX || !session_valid(&sessions[i], time(NULL)))
+      return NULL;
+   return &sessions[i];
+}
+
+/*热重启时恢复一个会话*/
+void session_restore(const struct session *s)
+{
+   for (int i = 0; i < SESSION_MAX; i++)
+   {
+      if (!session_valid(&sessions[i], time(NULL)))
+      {
+         sessions[i] = *s;
+         return;
+      }
+   }
+}